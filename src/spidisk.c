@@ -31,7 +31,8 @@
 //
 // ******************************************************************* //
 
-#include <io.h>
+#include <stddef.h>
+#include <string.h>
 #include "fatfs/diskio.h"
 #include "fatfs/ffconf.h"
 #include "spidisk.h"
@@ -43,11 +44,6 @@
 /* Define a macro                                                        */
 /*-----------------------------------------------------------------------*/
 
-#define SPI_SS_ASSERT			(1<<8)
-#define SPI_SS_NEGATE			((0<<8)|0xff)
-#define SPI_TRANS_START			(1<<9)
-#define SPI_TRANS_READY			(1<<9)
-
 #define SPI_PAGE_SIZE			(256)	// vOy[WTCY (oCg) 
 #define SPI_ERASEPAGE_COUNT		(16)	// y[W(4koCg/ZN^) 
 #define SPI_ERASE_SIZE			(SPI_PAGE_SIZE * SPI_ERASEPAGE_COUNT)
@@ -60,6 +56,13 @@
 #define SPI_CMD_READ_SFDP		(0x5a)
 #define SPI_CMD_RESET_ENABLE	(0x66)
 #define SPI_CMD_RESET			(0x99)
+#define SPI_CMD_WRITE_STATUS	(0x01)
+#define SPI_CMD_READ_STATUS2	(0x35)
+#define SPI_CMD_WRITE_STATUS2	(0x31)
+#define SPI_CMD_READ_STATUS3E	(0x3f)	// QE=SR2 bit7̃foCXp 
+#define SPI_CMD_WRITE_STATUS3E	(0x3e)
+
+#define SPI_STATUS_WIP			(1<<0)	// Xe[^XWX^busyrbg 
 
 #define SPI_CMD_PAGE_PROGRAM	(0x02)
 #define SPI_CMD_SECTOR_ERASE	(0x20)
@@ -68,23 +71,93 @@
 
 #define SPI_CMD4_PAGE_PROGRAM	(0x12)
 #define SPI_CMD4_SECTOR_ERASE	(0x21)
+
+#define SPI_CMD_BLOCK32_ERASE	(0x52)
+#define SPI_CMD_BLOCK64_ERASE	(0xd8)
+#define SPI_CMD4_BLOCK32_ERASE	(0x5c)
+#define SPI_CMD4_BLOCK64_ERASE	(0xdc)
+#define SPI_BLOCK_SECTORS(_i)	(8 << (_i))	// ubÑZN^([0]=32kB / [1]=64kB) 
 #define SPI_CMD4_READ_DATA		(0x13)
 #define SPI_CMD4_FAST_READ		(0x0c)
 
+#define SPI_CMD_DUAL_OUTPUT_READ	(0x3b)	// 1-1-2 
+#define SPI_CMD_DUAL_IO_READ		(0xbb)	// 1-2-2 
+#define SPI_CMD_QUAD_OUTPUT_READ	(0x6b)	// 1-1-4 
+#define SPI_CMD_QUAD_IO_READ		(0xeb)	// 1-4-4 
+
+#define SPI_CMD4_DUAL_OUTPUT_READ	(0x3c)
+#define SPI_CMD4_DUAL_IO_READ		(0xbc)
+#define SPI_CMD4_QUAD_OUTPUT_READ	(0x6c)
+#define SPI_CMD4_QUAD_IO_READ		(0xec)
+
 #define SPI_RETRY_COUNT			(3)		// G[̍Ďs 
 
+#define SPI_POLL_DIV			(64)	// \Ԃ߂Ẵ|[OԊu(WԂɑ΂) 
+#define SPI_POLL_MIN_US			(20)	// |[OԊu̍ŏl(us) 
+
 #if !_FS_READONLY
  #define _USE_SPI_WRITE			1
 #else
  #define _USE_SPI_WRITE			0
 #endif
 
+#if (_USE_SPI_WRITE && SPI_ERASE_POOL > 0)
+ #define _USE_SPI_ERASEPOOL		1
+#else
+ #define _USE_SPI_ERASEPOOL		0
+#endif
+
+#if (_USE_SPI_WRITE && SPI_WBCACHE_COUNT > 0)
+ #define _USE_SPI_WBCACHE		1
+ #define SPI_WBCACHE_EMPTY		(0xffffffff)
+#else
+ #define _USE_SPI_WBCACHE		0
+#endif
+
 #if (_USE_SPI_WRITE && _USE_MKFS)
  #define _USE_SPI_FORMAT		1
 #else
  #define _USE_SPI_FORMAT		0
 #endif
 
+#if (_USE_SPI_LOGFTL && _USE_SPI_SATCACHE)
+ #define _USE_SPI_LOG			1
+#else
+ #define _USE_SPI_LOG			0
+#endif
+
+#if (_USE_SPI_SATJOURNAL && _USE_SPI_SATCACHE)
+ #define _USE_SPI_SATJNL		1
+#else
+ #define _USE_SPI_SATJNL		0
+#endif
+
+#if (_USE_SPI_WRITE && _USE_SPI_LOG && SPI_WEAR_THRESHOLD > 0 && SPI_WEAR_MOVES > 0)
+ #define _USE_SPI_WEARMOVE		1
+#else
+ #define _USE_SPI_WEARMOVE		0
+#endif
+
+// փZN^̎gp}bv 
+// fBXNZN^̃y[W1'rsvm'uǍ̃oCgփZN^蓖Ă邲Ƃɐ擪0x00ɂ 
+// (1ZN^1oCggAԂ̃oCgvÔœoCg2vOȂ) 
+#define SPI_RSVMAP_OFFSET		(SPI_PAGE_SIZE)
+#define SPI_RSVMAP_COUNT		(SPI_ERASE_SIZE - SPI_RSVMAP_OFFSET - 4)
+
+// W[i(O\̃{[ƁAŒ芄蓖Ẵ{[̑փZN^̋L^) 
+// W[ĩR[h8oCg(WORD a, WORD b, WORD ~a, WORD ~b)ŁA␔vȂ̂͏ݓrƂĖ 
+// eW[iZN^̐擪R[h̓wb_(a=V[PXԍ, b=ɂ`FbN|Cg) 
+#define SPI_JNL_RECORD_SIZE		(8)
+#define SPI_JNL_RECORDS			(SPI_ERASE_SIZE / SPI_JNL_RECORD_SIZE)	// W[iZN^̃R[h(wb_܂) 
+#define SPI_FTL_UNMAPPED		(0xffff)	// ZN^蓖ĂĂȂLBA(R[hb) 
+#define SPI_FTL_BADMARK			(0xfffe)	// sǃZN^̃R[h(R[haAb͕ZN^) 
+#define SPI_FTL_BAD				(0xffff)	// sǃZN^(phy_table̒l) 
+#define SPI_FTL_WEARMAX			(0xfffe)	// 񐔂̏(phy_table̒l) 
+#define SPI_FTL_WINDOW			(SPI_WEAR_WINDOW > 0 ? SPI_WEAR_WINDOW : 1)
+#define SPI_FTL_USED(_x)		(spidisk->used_map[(_x) >> 3] & (1 << ((_x) & 7)))
+#define SPI_FTL_SETUSED(_x)		(spidisk->used_map[(_x) >> 3] |= (1 << ((_x) & 7)))
+#define SPI_FTL_CLRUSED(_x)		(spidisk->used_map[(_x) >> 3] &= ~(1 << ((_x) & 7)))
+
 
 #define RIFF_SET_ID(_x, _id0,_id1,_id2,_id3)\
 	*(((BYTE *)(_x))+0)=(_id0);\
@@ -131,13 +204,18 @@
  #define spiff_free(_x)			free(_x)
 #endif
 
-#if _USE_SPI_WRITE
+#if _USE_SPI_WRITE || _USE_SPI_FASTREAD
  #include <unistd.h>
- #define spiff_delay_ms(_x)		usleep((_x)*1000)		// 1msPʂő҂֐̃}N 
+ #define spiff_delay_us(_x)		usleep(_x)				// 1usPʂő҂֐̃}N 
 #endif
 
 
 DEF_SPIDISK *spidisk = NULL;	// SPIfBXNnh 
+DEF_SPIDISK spidiskinfo;		// SPIfBXN(foCXp[^܂) 
+
+static DEF_SPICOMMAND spi_dma_cmd;		// sDMA]̃fBXNv^ 
+static volatile DRESULT spi_dma_res;	// DMA]̌(RES_NOTRDY=]) 
+static BYTE spi_dma_busy;				// DMA]̎s 
 
 
 
@@ -145,569 +223,2740 @@ DEF_SPIDISK *spidisk = NULL;	// SPI
 /* SPI master peripheral handler                                         */
 /*-----------------------------------------------------------------------*/
 
-// SPI}X^ytF̒ʐM҂ 
-static DWORD spi_waitready(void)
+// SPI}X^C^[tF[Xo^ 
+DRESULT spidisk_register(
+	const DEF_SPIDISK_IF *spi_if,
+	void *context
+)
 {
-	DWORD res;
+	if (spi_if == NULL || spi_if->select == NULL || spi_if->transfer == NULL) return RES_PARERR;
 
-	do {
-		res = IORD(SPI_DEV, 0);
-	} while( !(res & SPI_TRANS_READY) );
+	spidiskinfo.spi_if = spi_if;
+	spidiskinfo.spi_context = context;
+	spidiskinfo.map_base = NULL;
 
-	return res;
+	return RES_OK;
+}
+
+
+// DMA]̊ʒm 
+static void spi_dma_complete(
+	void *arg,
+	DRESULT res
+)
+{
+	const DEF_SPIDISK_IF *spi = spidiskinfo.spi_if;
+
+	*(volatile DRESULT *)arg = res;
+	if (spi->signal != NULL) spi->signal(spidiskinfo.spi_context);
 }
 
-// SPI}X^1oCg̑Ms 
-static DWORD spi_transaction(
-	DWORD send
+#if _USE_SPI_CONTINUOUSREAD
+static DRESULT spi_issue(const DEF_SPICOMMAND *cmd, BYTE async);
+
+// Aǂݏo[h𔲂([hrbg0ɂă[hNbN܂łŏI) 
+// ׂĂ̐M0̂߁AAǂݏo[hłȂꍇNOPR}hɂȂ 
+static void spi_continuous_exit(
+	BYTE addr_bytes
 )
 {
-	IOWR(SPI_DEV, 0, SPI_TRANS_START | send);
-	return spi_waitready();
+	DEF_SPICOMMAND cmd;
+
+	cmd.opcode = 0;
+	cmd.no_opcode = 1;
+	cmd.addr_bytes = addr_bytes;
+	cmd.addr_width = 4;
+	cmd.data_width = 4;
+	cmd.dummy_clocks = 2;
+	cmd.mode_bits = 0x00;
+	cmd.address = 0;
+	cmd.txbuff = NULL;
+	cmd.rxbuff = NULL;
+	cmd.length = 0;
+
+	spidiskinfo.read_continuous = 0;
+	spi_issue(&cmd, 0);
 }
+#endif
 
+// sDMA]̊҂ 
+static DRESULT spi_sync(void)
+{
+	const DEF_SPIDISK_IF *spi = spidiskinfo.spi_if;
 
+	if (!spi_dma_busy) return RES_OK;
 
-/*-----------------------------------------------------------------------*/
-/* Access to SPI Flash device                                            */
-/*-----------------------------------------------------------------------*/
+	while(spi_dma_res == RES_NOTRDY) {								// ʒm҂ 
+		if (spi->wait != NULL) spi->wait(spidiskinfo.spi_context, SPI_DMA_WAIT_US);	// ҂̊Ԃ͑̃^XNɏ 
+	}
+	spi_dma_busy = 0;
 
-static DRESULT spi_getinfo(
-	DWORD *memsize,
-	DWORD *id
+	return spi_dma_res;
+}
+
+
+// 1̃`bvZNgŃR}h𔭍s 
+// async1̏ꍇADMA]Jn犮҂ɖ߂(spi_syncŊ҂) 
+static DRESULT spi_issue(
+	const DEF_SPICOMMAND *cmd,
+	BYTE async
 )
 {
-	BYTE sfdp[16];		// SFDP work
-	DWORD jedecid;
+	const DEF_SPIDISK_IF *spi = spidiskinfo.spi_if;
+	void *ctx = spidiskinfo.spi_context;
+	const BYTE *p;
+	BYTE *v;
+	DWORD n;
 	UINT i;
 
-	dgb_printf("[SPI] flash device info\n");
-	spi_waitready();
+	spi_sync();
 
-	/* JEDEC ID̓ǂݏo */
+#if _USE_SPI_CONTINUOUSREAD
+	// AǂݏoȊÕR}h̑OɘAǂݏo[h𔲂 
+	if (spidiskinfo.read_continuous && !cmd->no_opcode) spi_continuous_exit(spidiskinfo.read_continuous);
+#endif
 
-	spi_transaction(SPI_SS_ASSERT | SPI_CMD_GET_JEDECID);
-	jedecid  = (spi_transaction(SPI_SS_ASSERT | 0xff) & 0xff) << 16;	// MID
-	jedecid |= (spi_transaction(SPI_SS_ASSERT | 0xff) & 0xff) << 8;		// DID2
-	jedecid |= (spi_transaction(SPI_SS_ASSERT | 0xff) & 0xff) << 0;		// DID1
-	spi_transaction(SPI_SS_NEGATE);
+#if _USE_SPI_MAPPEDREAD
+	// R}h̔s̓R}h[hōs 
+	if (spidiskinfo.map_base != NULL) {
+		spi->map(ctx, 0);
+		spidiskinfo.map_base = NULL;
+	}
+#endif
 
-	*id = jedecid;
-	dgb_printf("    manufacturer ID = 0x%02x\n    device ID = 0x%04x\n",
-					(jedecid >> 16)& 0xff, jedecid & 0xffff);
+	// DMA](fBXNv^͊܂ŕێ) 
+	if (spi->dma != NULL && cmd->length >= SPI_PAGE_SIZE) {
+		spi_dma_cmd = *cmd;
+		spi_dma_res = RES_NOTRDY;
+		if (spi->dma(ctx, &spi_dma_cmd, spi_dma_complete, (void *)&spi_dma_res) == RES_OK) {
+			spi_dma_busy = 1;
+			return async ? RES_OK : spi_sync();
+		}
+	}
 
+	// o[Xg] 
+	if (spi->burst != NULL) return spi->burst(ctx, cmd);
 
-#if _USE_SPI_AUTODETECT
-	/* SFDPwb_ǂݏo */
+	// 1oCg̑MŃG~[g(oX1̂) 
+	spi->select(ctx, 1);
 
-	spi_transaction(SPI_SS_ASSERT | SPI_CMD_READ_SFDP);
-	spi_transaction(SPI_SS_ASSERT | 0x00);		// A23-16
-	spi_transaction(SPI_SS_ASSERT | 0x00);		// A15-8
-	spi_transaction(SPI_SS_ASSERT | 0x00);		// A7-0
-	spi_transaction(SPI_SS_ASSERT | 0xff);		// dummy
+	if (!cmd->no_opcode) spi->transfer(ctx, cmd->opcode);
 
-	for(i=0 ; i<16 ; i++) {
-		sfdp[i] = spi_transaction(SPI_SS_ASSERT | 0xff) & 0xff;
+	for(i=cmd->addr_bytes ; i>0 ; i--) {
+		spi->transfer(ctx, (cmd->address >> ((i-1)*8))& 0xff);
+	}
+	for(i=cmd->dummy_clocks / 8 ; i>0 ; i--) {
+		spi->transfer(ctx, (i == cmd->dummy_clocks / 8)? cmd->mode_bits : 0xff);
 	}
-	spi_transaction(SPI_SS_NEGATE);
 
-	if (!RIFF_CHECK_ID(&sfdp[0], 'S','F','D','P')) return RES_NOTRDY;	// SFDPɑΉĂȂ 
-	dgb_printf("    SFDP supported\n    parameter table offset = 0x%02x%02x%02x\n",
-					sfdp[14], sfdp[13], sfdp[12]);
+	n = cmd->length;
+	if (cmd->rxbuff != NULL) {
+		v = cmd->rxbuff;
+		p = cmd->txbuff;
+		for( ; n>0 ; n--) *v++ = spi->transfer(ctx, p ? *p++ : 0xff);
+	} else if (cmd->txbuff != NULL) {
+		p = cmd->txbuff;
+		for( ; n>0 ; n--) spi->transfer(ctx, *p++);
+	} else {
+		for( ; n>0 ; n--) spi->transfer(ctx, 0xff);
+	}
+	spi->select(ctx, 0);
 
+	return RES_OK;
+}
 
-	/* eʂёΉ@\̎擾 */
+// 1̃`bvZNgŃR}h𔭍sĊ҂ 
+static DRESULT spi_burst(
+	const DEF_SPICOMMAND *cmd
+)
+{
+	return spi_issue(cmd, 0);
+}
 
-	spi_transaction(SPI_SS_ASSERT | SPI_CMD_READ_SFDP);
-	spi_transaction(SPI_SS_ASSERT | sfdp[14]);	// A23-16
-	spi_transaction(SPI_SS_ASSERT | sfdp[13]);	// A15-8
-	spi_transaction(SPI_SS_ASSERT | sfdp[12]);	// A7-0
-	spi_transaction(SPI_SS_ASSERT | 0xff);		// dummy
+#if _USE_SPI_WRITE || _USE_SPI_FASTREAD
+// 1usPʂő҂(C^[tF[XɎԑ҂Ȃꍇspiff_delay_usg) 
+static void spi_delay_us(
+	DWORD usec
+)
+{
+	const DEF_SPIDISK_IF *spi = spidiskinfo.spi_if;
 
-	for(i=0 ; i<8 ; i++) {
-		sfdp[i] = spi_transaction(SPI_SS_ASSERT | 0xff) & 0xff;
+	if (spi->delay != NULL) {
+		spi->delay(spidiskinfo.spi_context, usec);
+	} else {
+		spiff_delay_us(usec);
 	}
-	spi_transaction(SPI_SS_NEGATE);
+}
+#endif
 
-	if ((sfdp[0] & (3<<0)) != 1) return RES_NOTRDY;			// 4kBZN^ɑΉĂȂ 
-	if (sfdp[1] != SPI_CMD_SECTOR_ERASE) return RES_NOTRDY;
-	dgb_printf("    4kB erase supported\n    erase command set = 0x%02x\n", sfdp[1]);
+#if _USE_SPI_MAPPEDREAD
+// }bv[hɐ؂ւăx[XAhXԂ(NULL=}bvǂݏołȂ) 
+static const BYTE *spi_map(void)
+{
+	const DEF_SPIDISK_IF *spi = spidiskinfo.spi_if;
+
+	if (spidiskinfo.map_base == NULL && spi->map != NULL) {
+		spi_sync();
+ #if _USE_SPI_CONTINUOUSREAD
+		if (spidiskinfo.read_continuous) spi_continuous_exit(spidiskinfo.read_continuous);
+ #endif
+		spidiskinfo.map_base = spi->map(spidiskinfo.spi_context, 1);
+	}
 
-	if (!((sfdp[2] & (3<<1)) == (0<<1) || (sfdp[2] & (3<<1)) == (1<<1))) return RES_NOTRDY;
-															// 3byteAhbVOɑΉĂȂ 
-	dgb_printf("    3byte addressing supported\n");
+	return spidiskinfo.map_base;
+}
+#endif
 
-	switch (sfdp[7]) {
-		default:
-			return RES_NOTRDY;
-			break;
+#if _USE_SPI_WRITE
+// ͈͂̃LbV𖳌 
+static void spi_invalidate(
+	DWORD address,
+	DWORD length
+)
+{
+	const DEF_SPIDISK_IF *spi = spidiskinfo.spi_if;
 
-		case 0x00:	// 16Mbit
-			*memsize = 2*1024*1024;
-			break;
-		case 0x01:	// 32Mbit
-			*memsize = 4*1024*1024;
-			break;
-		case 0x03:	// 64Mbit
-			*memsize = 8*1024*1024;
-			break;
-		case 0x07:	// 128Mbit
-			*memsize = 16*1024*1024;
-			break;
-		case 0x0f:	// 256Mbit
-			*memsize = 32*1024*1024;
-			break;
-		case 0x1f:	// 512Mbit
-			*memsize = 64*1024*1024;
-			break;
-		case 0x3f:	// 1Gbit
-			*memsize = 128*1024*1024;
-			break;
-		case 0x7f:	// 2Gbit
-			*memsize = 256*1024*1024;
-			break;
-	}
-#else
-		*memsize = SPI_FLASH_MEMSIZE;
-		dgb_printf("    forced settings\n");
+	if (spi->invalidate != NULL) spi->invalidate(spidiskinfo.spi_context, address, length);
+}
 #endif
 
-	dgb_printf("    flash memory size = %d bytes\n", *memsize);
+// SPI}X^goX 
+static BYTE spi_buswidth(void)
+{
+	const DEF_SPIDISK_IF *spi = spidiskinfo.spi_if;
+
+	return (spi->burst != NULL && spi->buswidth > 1)? spi->buswidth : 1;
+}
 
 
-	return RES_OK;
+
+/*-----------------------------------------------------------------------*/
+/* Access to SPI Flash device                                            */
+/*-----------------------------------------------------------------------*/
+
+// R}hfBXNv^(oX1AAhXEf[^tF[YȂ) 
+static void spi_setcommand(
+	DEF_SPICOMMAND *cmd,
+	BYTE opcode
+)
+{
+	cmd->opcode = opcode;
+	cmd->no_opcode = 0;
+	cmd->addr_bytes = 0;
+	cmd->addr_width = 1;
+	cmd->data_width = 1;
+	cmd->dummy_clocks = 0;
+	cmd->mode_bits = 0xff;
+	cmd->address = 0;
+	cmd->txbuff = NULL;
+	cmd->rxbuff = NULL;
+	cmd->length = 0;
 }
 
+// f[^tF[ŶȂR}h𔭍s 
+static DRESULT spi_command(
+	BYTE opcode
+)
+{
+	DEF_SPICOMMAND cmd;
 
-static DRESULT spi_read(
-	BYTE *buff,
+	spi_setcommand(&cmd, opcode);
+
+	return spi_burst(&cmd);
+}
+
+// AhXt̃R}h𔭍s(16MoCgȏ4oCgAhXR}hg) 
+static DRESULT spi_command_address(
+	BYTE opcode3,		/* 3byte address command */
+	BYTE opcode4,		/* 4byte address command */
 	DWORD address,
-	DWORD byte
+	const BYTE *txbuff,
+	BYTE *rxbuff,
+	DWORD length
 )
 {
-	spi_waitready();
+	DEF_SPICOMMAND cmd;
 
 	if (address >= 16*1024*1024) {
-		spi_transaction(SPI_SS_ASSERT | SPI_CMD4_READ_DATA);		// Read 4byte address
-		spi_transaction(SPI_SS_ASSERT |((address >> 24)& 0xff));
+		spi_setcommand(&cmd, opcode4);
+		cmd.addr_bytes = 4;
 	} else {
-		spi_transaction(SPI_SS_ASSERT | SPI_CMD_READ_DATA);			// Read 3byte address
+		spi_setcommand(&cmd, opcode3);
+		cmd.addr_bytes = 3;
 	}
-	spi_transaction(SPI_SS_ASSERT |((address >> 16)& 0xff));
-	spi_transaction(SPI_SS_ASSERT |((address >>  8)& 0xff));
-	spi_transaction(SPI_SS_ASSERT |((address >>  0)& 0xff));
-
-	do {
-		*buff++ = (spi_transaction(SPI_SS_ASSERT | 0xff) & 0xff);
-	} while (--byte);
-	spi_transaction(SPI_SS_NEGATE);
+	cmd.address = address;
+	cmd.txbuff = txbuff;
+	cmd.rxbuff = rxbuff;
+	cmd.length = length;
 
-	return RES_OK;
+	return spi_burst(&cmd);
 }
 
-
-#if _USE_SPI_WRITE
-static DRESULT spi_erase_sector(
-	DWORD address
+// SFDPe[uǂݏo 
+static DRESULT spi_read_sfdp(
+	BYTE *buff,
+	DWORD address,
+	DWORD byte
 )
 {
-	DWORD res;
-	UINT t;
+	DEF_SPICOMMAND cmd;
 
-	address &= ~(SPI_ERASE_SIZE-1);
-	spi_waitready();
+	spi_setcommand(&cmd, SPI_CMD_READ_SFDP);
+	cmd.addr_bytes = 3;
+	cmd.dummy_clocks = 8;
+	cmd.address = address;
+	cmd.rxbuff = buff;
+	cmd.length = byte;
 
-	// ݃Cl[u 
-	spi_transaction(SPI_SS_ASSERT | SPI_CMD_WRITE_ENABLE);			// WP Unlock
-	spi_transaction(SPI_SS_NEGATE);
+	return spi_burst(&cmd);
+}
 
-	// ZN^ 
-	if (address >= 16*1024*1024) {
-		spi_transaction(SPI_SS_ASSERT | SPI_CMD4_SECTOR_ERASE);		// Erase sector(4byte address)
-		spi_transaction(SPI_SS_ASSERT |((address >> 24)& 0xff));
-	} else {
-		spi_transaction(SPI_SS_ASSERT | SPI_CMD_SECTOR_ERASE);		// Erase sector(3byte address)
-	}
-	spi_transaction(SPI_SS_ASSERT |((address >> 16)& 0xff));
-	spi_transaction(SPI_SS_ASSERT |((address >>  8)& 0xff));
-	spi_transaction(SPI_SS_ASSERT |((address >>  0)& 0xff));
-	spi_transaction(SPI_SS_NEGATE);
+// WX^1oCgǂݏo 
+static BYTE spi_read_register(
+	BYTE opcode
+)
+{
+	DEF_SPICOMMAND cmd;
+	BYTE res;
 
-	// ҂ 
-	for(t=SPI_ERASE_WAIT_MAX ; t>0 ; t--) {
-		spi_transaction(SPI_SS_ASSERT | SPI_CMD_READ_STATUS);		// Read Status
-		res = spi_transaction(SPI_SS_ASSERT | 0xff);
-		spi_transaction(SPI_SS_NEGATE);
+	spi_setcommand(&cmd, opcode);
+	cmd.rxbuff = &res;
+	cmd.length = 1;
 
-		if (!(res & (1<<0))) break;									// busy1̊ԑ҂ 
-		spiff_delay_ms(1);											// 1msȏ҂ 
-	}
-	if (t == 0) {
-		spi_transaction(SPI_SS_ASSERT | SPI_CMD_RESET_ENABLE);		// ^CAEg foCXZbg 
-		spi_transaction(SPI_SS_NEGATE);
-		spi_transaction(SPI_SS_ASSERT | SPI_CMD_RESET);
-		spi_transaction(SPI_SS_NEGATE);
+	spi_burst(&cmd);
 
-		return RES_ERROR;
-	}
+	return res;
+}
 
-	return RES_OK;
+// Xe[^XWX^ǂݏo 
+static BYTE spi_read_status(void)
+{
+	return spi_read_register(SPI_CMD_READ_STATUS);
 }
 
 
-static DRESULT spi_program_page(
-	const BYTE *buff,	/* Data to be written */
-	DWORD address
+#if _USE_SPI_WRITE
+// ҂Ԃ̃p[^ݒ肷(typ_us0̏ꍇ͗\poll_usԊuŃ|[O) 
+static void spi_setbusytime(
+	DEF_SPIBUSYTIME *bt,
+	DWORD typ_us,
+	DWORD max_us,
+	DWORD poll_us
 )
 {
-	const BYTE *p;
-	BYTE *v, verify[SPI_PAGE_SIZE];
-	UINT n;
+	bt->typ_us = typ_us;
+	bt->max_us = (max_us > SPI_ERASE_WAIT_MAX*1000)? max_us : SPI_ERASE_WAIT_MAX*1000;
+	bt->poll_us = (typ_us == 0)? poll_us : typ_us / SPI_POLL_DIV;
+	if (bt->poll_us < SPI_POLL_MIN_US) bt->poll_us = SPI_POLL_MIN_US;
+	bt->avg_us = typ_us;
+	bt->last_us = 0;
+	bt->count = 0;
+}
 
-	address &= ~(SPI_PAGE_SIZE-1);
-	spi_waitready();
+// busy܂ő҂ 
+// \Ԃ7/8܂ł̓Xe[^Xǂ܂ɑ҂Ǎׂ͍ԊuŃ|[O 
+static DRESULT spi_waitbusy(
+	DEF_SPIBUSYTIME *bt
+)
+{
+	DWORD elapsed;
 
-	// ݃Cl[u 
-	spi_transaction(SPI_SS_ASSERT | SPI_CMD_WRITE_ENABLE);			// WP Unlock
-	spi_transaction(SPI_SS_NEGATE);
+	elapsed = bt->avg_us - bt->avg_us / 8;
+	if (elapsed > 0) spi_delay_us(elapsed);							// ҂̊Ԃ͑̃^XNɏ 
 
-	// y[W 
-	if (address >= 16*1024*1024) {
-		spi_transaction(SPI_SS_ASSERT | SPI_CMD4_PAGE_PROGRAM);		// Page program(4byte address)
-		spi_transaction(SPI_SS_ASSERT |((address >> 24)& 0xff));
-	} else {
-		spi_transaction(SPI_SS_ASSERT | SPI_CMD_PAGE_PROGRAM);		// Page program(3byte address)
+	while(spi_read_status() & SPI_STATUS_WIP) {						// busy1̊ԑ҂ 
+		if (elapsed >= bt->max_us) return RES_ERROR;
+		spi_delay_us(bt->poll_us);
+		elapsed += bt->poll_us;
 	}
-	spi_transaction(SPI_SS_ASSERT |((address >> 16)& 0xff));
-	spi_transaction(SPI_SS_ASSERT |((address >>  8)& 0xff));
-	spi_transaction(SPI_SS_ASSERT |((address >>  0)& 0xff));
 
-	p = buff;
-	for(n=SPI_PAGE_SIZE ; n>0 ; n--) spi_transaction(SPI_SS_ASSERT | *p++);
-	spi_transaction(SPI_SS_NEGATE);
+	// Ԃŗ\ԂXV(1/8̈ړ) 
+	bt->last_us = elapsed;
+	bt->avg_us = bt->avg_us - bt->avg_us / 8 + elapsed / 8;
+	bt->count++;
 
-	// ݊҂ 
-	spi_transaction(SPI_SS_ASSERT | SPI_CMD_READ_STATUS);			// Read Status
-	while(spi_transaction(SPI_SS_ASSERT | 0xff) & (1<<0)) {}		// busy1̊ԑ҂ 
-	spi_transaction(SPI_SS_NEGATE);
+	return RES_OK;
+}
 
-	// xt@C 
-	spi_read(verify, address, SPI_PAGE_SIZE);
-	p = buff;
-	v = verify;
-	for(n=SPI_PAGE_SIZE ; n>0 ; n--) {
-		if (*p++ != *v++) break;
+#define SPI_ERASE_RUNNING		(0)		// ̏ : s 
+#define SPI_ERASE_SUSPENDED		(1)		// ̏ : TXyh 
+#define SPI_ERASE_RESUMED		(2)		// ̏ : TXyhɃW[ 
+
+// ̊҂̌㏈(^CAEgꍇ̓foCXZbg) 
+static DRESULT spi_erase_end(
+	DRESULT res,
+	DWORD address,
+	DWORD size
+)
+{
+	spi_invalidate(address, size);
+	if (res != RES_OK) {
+		spi_command(SPI_CMD_RESET_ENABLE);							// ^CAEg foCXZbg 
+		spi_command(SPI_CMD_RESET);
+
+		return RES_ERROR;
 	}
-	if (n != 0) return RES_ERROR;
 
 	return RES_OK;
 }
-#endif
 
+// ҂ɖ߂̊҂ 
+static DRESULT spi_erase_finish(void)
+{
+	DEF_SPIBUSYTIME *bt = spidiskinfo.erase_busy;
+	DRESULT res = RES_OK;
+	DWORD size, elapsed;
 
+	size = spidiskinfo.erase_size;
+	if (size == 0) return RES_OK;
 
-/*-----------------------------------------------------------------------*/
-/* Format a physical disk                                                */
-/*-----------------------------------------------------------------------*/
+	if (spidiskinfo.erase_state == SPI_ERASE_SUSPENDED) spi_command(spidiskinfo.resume_cmd);
 
-#if _USE_SPI_FORMAT
-DRESULT spidisk_format(
-	DWORD disksize,
-	WORD rsv_count
+	// JňoߎԂȂߗ\͂Ƀ|[O 
+	for(elapsed=0 ; spi_read_status() & SPI_STATUS_WIP ; elapsed += bt->poll_us) {
+		if (elapsed >= bt->max_us) {
+			res = RES_ERROR;
+			break;
+		}
+		spi_delay_us(bt->poll_us);
+	}
+	spidiskinfo.erase_size = 0;
+
+	return spi_erase_end(res, spidiskinfo.erase_address, size);
+}
+
+// ǂݏȏOɎs̏TXyh 
+// ǂݏo͈͂̏ꍇTXyhłȂfoCXł͏̊҂ 
+static DRESULT spi_erase_suspend(
+	DWORD address,
+	DWORD byte
 )
 {
-	DWORD memsize, id, diskinfo_sector, startaddr;
-	WORD rsv_top_sector, sat_top_sector;
-	WORD all_sector_count, rsv_sector_count, sat_sector_count, dat_sector_count;
-	DWORD address, sat_address;
-	WORD lba_sector, phy_sector, rsv_sector;
-	UINT n, retry;
-	BYTE buff[SPI_PAGE_SIZE];
+	DWORD elapsed;
 
-	/* p[^vZ */
+	if (spidiskinfo.erase_size == 0) return RES_OK;
 
-	if (spi_getinfo(&memsize, &id)) return RES_NOTRDY;
+	if (!_USE_SPI_SUSPEND || spidiskinfo.suspend_cmd == 0 ||
+			(address < spidiskinfo.erase_address + spidiskinfo.erase_size && address + byte > spidiskinfo.erase_address)) {
+		return spi_erase_finish();
+	}
+	if (spidiskinfo.erase_state == SPI_ERASE_SUSPENDED) return RES_OK;
 
-	dgb_printf("[DISK] spi disk format\n");
+	// ɊĂ΃TXyhȂ 
+	if (!(spi_read_status() & SPI_STATUS_WIP)) return spi_erase_finish();
 
-	if (disksize == 0) disksize = memsize;
-	if (disksize < 1*1024*1024) {
-		dgb_printf("[!] format parameter error\n");
-		return RES_PARERR;
-	}
+	// W[Ă玟̃TXyh܂ł͏i߂邽߂̊Ԋu 
+	if (spidiskinfo.erase_state == SPI_ERASE_RESUMED) spi_delay_us(spidiskinfo.resume_us);
 
-	all_sector_count = (disksize / SPI_ERASE_SIZE) - 1;
+	spi_command(spidiskinfo.suspend_cmd);
+	spidiskinfo.erase_state = SPI_ERASE_SUSPENDED;
+	spidiskinfo.stat.suspend_count++;
 
-	if (memsize < (all_sector_count + 1) * SPI_ERASE_SIZE) {
-		dgb_printf("[!] format parameter error\n");
-		return RES_PARERR;
+	for(elapsed=0 ; spi_read_status() & SPI_STATUS_WIP ; elapsed += SPI_POLL_MIN_US) {
+		if (elapsed > spidiskinfo.suspend_us) return spi_erase_finish();	// TXyhłȂΊ҂ 
+		spi_delay_us(SPI_POLL_MIN_US);
 	}
 
-	if (rsv_count == 0) {
-		rsv_sector_count = (all_sector_count / 32) + 10;
-	} else {
-		rsv_sector_count = rsv_count;
+	return RES_OK;
+}
+
+// TXyhW[ 
+static void spi_erase_resume(void)
+{
+	if (spidiskinfo.erase_size != 0 && spidiskinfo.erase_state == SPI_ERASE_SUSPENDED) {
+		spi_command(spidiskinfo.resume_cmd);
+		spidiskinfo.erase_state = SPI_ERASE_RESUMED;
 	}
+}
+#endif
 
-	sat_sector_count = ((all_sector_count - rsv_sector_count)*2 / SPI_ERASE_SIZE) + 1;
-	dat_sector_count = all_sector_count - rsv_sector_count - sat_sector_count;
 
-	if (dat_sector_count < 128) {
-		dgb_printf("[!] format parameter error\n");
-		return RES_PARERR;
-	}
+#if _USE_SPI_AUTODETECT && _USE_SPI_FASTREAD
+// WX^ɏŊ҂ 
+static DRESULT spi_write_register(
+	BYTE opcode,
+	const BYTE *data,
+	UINT byte
+)
+{
+	DEF_SPICOMMAND cmd;
+	UINT t;
 
-	diskinfo_sector = (memsize / SPI_ERASE_SIZE) - 1;
-	startaddr = memsize - (all_sector_count + 1) * SPI_ERASE_SIZE;
-	sat_top_sector = all_sector_count - sat_sector_count;
-	rsv_top_sector = all_sector_count - sat_sector_count - rsv_sector_count;
+	spi_command(SPI_CMD_WRITE_ENABLE);								// WP Unlock
 
+	spi_setcommand(&cmd, opcode);
+	cmd.txbuff = data;
+	cmd.length = byte;
+	spi_burst(&cmd);
 
-	dgb_printf("    diskinfo offset = 0x%08x (sector %d)\n",
+	for(t=SPI_ERASE_WAIT_MAX ; t>0 ; t--) {
+		if (!(spi_read_status() & SPI_STATUS_WIP)) break;			// busy1̊ԑ҂ 
+		spi_delay_us(1000);
+	}
+
+	return (t == 0)? RES_ERROR : RES_OK;
+}
+
+// Quad EnablerbgZbg(qerSFDP DWORD15Quad Enable Requirements) 
+static DRESULT spi_quad_enable(
+	BYTE qer
+)
+{
+	BYTE sr[2];
+
+	switch (qer) {
+		case 0:		// QErbgȂ 
+			return RES_OK;
+
+		case 1:		// SR2 bit1 : 01h2oCg 
+		case 4:
+		case 5:
+			sr[0] = spi_read_status();
+			sr[1] = spi_read_register(SPI_CMD_READ_STATUS2);
+			if (sr[1] & (1<<1)) return RES_OK;
+			sr[1] |= (1<<1);
+			if (spi_write_register(SPI_CMD_WRITE_STATUS, sr, 2)) return RES_ERROR;
+			return (spi_read_register(SPI_CMD_READ_STATUS2) & (1<<1))? RES_OK : RES_ERROR;
+
+		case 2:		// SR1 bit6 : 01h1oCg 
+			sr[0] = spi_read_status();
+			if (sr[0] & (1<<6)) return RES_OK;
+			sr[0] |= (1<<6);
+			if (spi_write_register(SPI_CMD_WRITE_STATUS, sr, 1)) return RES_ERROR;
+			return (spi_read_status() & (1<<6))? RES_OK : RES_ERROR;
+
+		case 3:		// SR2 bit7 : 3fhœǂݏoA3ehŏ 
+			sr[0] = spi_read_register(SPI_CMD_READ_STATUS3E);
+			if (sr[0] & (1<<7)) return RES_OK;
+			sr[0] |= (1<<7);
+			if (spi_write_register(SPI_CMD_WRITE_STATUS3E, sr, 1)) return RES_ERROR;
+			return (spi_read_register(SPI_CMD_READ_STATUS3E) & (1<<7))? RES_OK : RES_ERROR;
+
+		case 6:		// SR2 bit1 : 35hœǂݏoA31hŏ 
+			sr[0] = spi_read_register(SPI_CMD_READ_STATUS2);
+			if (sr[0] & (1<<1)) return RES_OK;
+			sr[0] |= (1<<1);
+			if (spi_write_register(SPI_CMD_WRITE_STATUS2, sr, 1)) return RES_ERROR;
+			return (spi_read_register(SPI_CMD_READ_STATUS2) & (1<<1))? RES_OK : RES_ERROR;
+
+		default:
+			break;
+	}
+
+	return RES_ERROR;
+}
+
+// 3oCgAhX̓ǂݏoR}hɑΉ4oCgAhXR}hԂ 
+static BYTE spi_read_cmd4(
+	BYTE opcode
+)
+{
+	switch (opcode) {
+		case SPI_CMD_FAST_READ:			return SPI_CMD4_FAST_READ;
+		case SPI_CMD_DUAL_OUTPUT_READ:	return SPI_CMD4_DUAL_OUTPUT_READ;
+		case SPI_CMD_DUAL_IO_READ:		return SPI_CMD4_DUAL_IO_READ;
+		case SPI_CMD_QUAD_OUTPUT_READ:	return SPI_CMD4_QUAD_OUTPUT_READ;
+		case SPI_CMD_QUAD_IO_READ:		return SPI_CMD4_QUAD_IO_READ;
+	}
+
+	return 0;
+}
+
+// SFDP̍ǂݏop[^ǂݏo[hI 
+static void spi_select_readmode(
+	const BYTE *bfpt,	/* JEDEC basic flash parameter table */
+	UINT dwords,		/* Number of DWORDs in table */
+	DWORD memsize
+)
+{
+	// ͕̍L : {DWORD1̃T|[grbg, p[^DWORD, rbgʒu, AhX, f[^} 
+	static const BYTE mode_list[4][5] = {
+		{21, 3,  0, 4, 4},		// 1-4-4 
+		{22, 3, 16, 1, 4},		// 1-1-4 
+		{20, 4, 16, 2, 2},		// 1-2-2 
+		{16, 4,  0, 1, 2}		// 1-1-2 
+	};
+	DWORD dw1, param;
+	BYTE opcode, qer;
+	UINT i;
+
+	dw1 = RIFF_GET_DWORD(&bfpt[0]);
+	qer = (dwords >= 15)? (bfpt[15*4-4+2] >> 4) & 7 : 0xff;		// DWORD15 bit22-20 
+
+	for(i=0 ; i<4 ; i++) {
+		if (!(dw1 & (1UL << mode_list[i][0]))) continue;
+		if (mode_list[i][3] > spi_buswidth() || mode_list[i][4] > spi_buswidth()) continue;
+
+		param = RIFF_GET_DWORD(&bfpt[mode_list[i][1]*4-4]);
+		param >>= mode_list[i][2];
+		opcode = (param >> 8) & 0xff;
+		if (memsize > 16*1024*1024 && spi_read_cmd4(opcode) == 0) continue;
+
+		if (mode_list[i][4] == 4) {
+			if (qer == 0xff) continue;							// QE̐ݒ@Ȃ 
+			if (spi_quad_enable(qer)) continue;
+		}
+
+		spidiskinfo.read_cmd = opcode;
+		spidiskinfo.read_cmd4 = spi_read_cmd4(opcode);
+		spidiskinfo.read_dummy = (param & 0x1f) + ((param >> 5) & 7);	// _~[{[hNbN 
+		spidiskinfo.read_addr_width = mode_list[i][3];
+		spidiskinfo.read_data_width = mode_list[i][4];
+
+ #if _USE_SPI_CONTINUOUSREAD
+		// 1-4-40-4-4[hɑΉĂꍇ͘Aǂݏo[hg 
+		// (DWORD15 bit9=Ή, bit10/14=[hrbgŏI, bit16=A5h/bit18=AxhŊJn) 
+		if (i == 0 && dwords >= 15 && ((param >> 5) & 7) == 2) {
+			param = RIFF_GET_DWORD(&bfpt[15*4-4]);
+			if ((param & (1<<9)) && (param & ((1<<10)|(1<<14)))) {
+				if (param & (1<<16)) {
+					spidiskinfo.read_mode_bits = 0xa5;
+				} else if (param & (1<<18)) {
+					spidiskinfo.read_mode_bits = 0xa0;
+				}
+			}
+		}
+ #endif
+		break;
+	}
+}
+#endif
+
+#if _USE_SPI_AUTODETECT && _USE_SPI_WRITE
+// SFDP̎ԃtB[h((JEg+1)~P)usPʂɕϊ 
+static DWORD spi_sfdp_time(
+	DWORD field,
+	UINT count_bits,
+	const DWORD *units
+)
+{
+	return ((field & ((1UL << count_bits) - 1)) + 1) * units[field >> count_bits];
+}
+
+// SFDP̏^CvƏEvOԂ犮҂Ԃݒ肷 
+static void spi_read_timing(
+	const BYTE *bfpt,	/* JEDEC basic flash parameter table */
+	UINT dwords			/* Number of DWORDs in table */
+)
+{
+	static const DWORD erase_units[4] = {1000, 16000, 128000, 1000000};
+	static const DWORD program_units[2] = {8, 64};
+ #if _USE_SPI_SUSPEND
+	static const DWORD suspend_units[4] = {128, 1000, 8000, 64000};	// nsP 
+ #endif
+	DWORD dw, typ, max;
+	BYTE size, opcode;
+	UINT i,n;
+
+	if (dwords < 9) return;
+
+	// DWORD8-9 : ^CṽTCY(2^N)ƃR}h(JESD2169DWORD̃e[uɂ) 
+	// DWORD10 : ^Cv̕W(bit10-4,17-11,24-18,31-25)Aő厞Ԃ͕Wԁ~2~(bit3-0+1) 
+	// DWORD10Ȃꍇ͎Ԃݒ肹AubN1msԊuŃ|[O 
+	dw = (dwords >= 11)? RIFF_GET_DWORD(&bfpt[10*4-4]) : 0;
+	for(i=0 ; i<4 ; i++) {
+		size = bfpt[7*4 + i*2];
+		opcode = bfpt[7*4 + i*2 + 1];
+		if (size == 0) continue;
+
+		typ = max = 0;
+		if (dwords >= 11) {
+			typ = spi_sfdp_time((dw >> (4 + i*7)) & 0x7f, 5, erase_units);
+			max = typ * ((dw & 0x0f) + 1) * 2;
+		}
+
+		if (dwords >= 11 && size == 12 && opcode == SPI_CMD_SECTOR_ERASE) {
+			spi_setbusytime(&spidiskinfo.erase_time, typ, max, 0);
+		}
+ #if _USE_SPI_BLOCKERASE
+		if (!((size == 15 && opcode == SPI_CMD_BLOCK32_ERASE) || (size == 16 && opcode == SPI_CMD_BLOCK64_ERASE))) continue;
+		n = size - 15;
+		spidiskinfo.block_cmd[n] = opcode;
+		spidiskinfo.block_cmd4[n] = (n == 0)? SPI_CMD4_BLOCK32_ERASE : SPI_CMD4_BLOCK64_ERASE;
+		spi_setbusytime(&spidiskinfo.block_time[n], typ, max, 1000);
+		dgb_printf("    %dkB block erase = 0x%02x, %dus (max %dus)\n", 1 << (size - 10), opcode, typ, max);
+ #endif
+	}
+
+	if (dwords < 11) return;
+
+	// DWORD11 : y[WvO̕W(bit13-8)Aő厞Ԃ͕Wԁ~2~(bit3-0+1) 
+	dw = RIFF_GET_DWORD(&bfpt[11*4-4]);
+	typ = spi_sfdp_time((dw >> 8) & 0x3f, 5, program_units);
+	spi_setbusytime(&spidiskinfo.program_time, typ, typ * ((dw & 0x0f) + 1) * 2, 0);
+
+	dgb_printf("    sector erase time = %dus (max %dus)\n    page program time = %dus (max %dus)\n",
+					spidiskinfo.erase_time.typ_us, spidiskinfo.erase_time.max_us,
+					spidiskinfo.program_time.typ_us, spidiskinfo.program_time.max_us);
+
+ #if _USE_SPI_SUSPEND
+	// DWORD12 : TXyh/W[̑Ή(bit31=0)ATXyh̍ő厞(bit30-24)A 
+	//           W[玟̃TXyh܂ł̊Ԋu(bit23-20A(l+1)~64us) 
+	// DWORD13 : TXyhR}h(bit31-24)AW[R}h(bit23-16) 
+	if (dwords < 13) return;
+	dw = RIFF_GET_DWORD(&bfpt[12*4-4]);
+	if (dw & (1UL<<31)) return;
+
+	spidiskinfo.suspend_us = (spi_sfdp_time((dw >> 24) & 0x7f, 5, suspend_units) + 999) / 1000;
+	spidiskinfo.resume_us = (((dw >> 20) & 0x0f) + 1) * 64;
+	dw = RIFF_GET_DWORD(&bfpt[13*4-4]);
+	spidiskinfo.suspend_cmd = (dw >> 24)& 0xff;
+	spidiskinfo.resume_cmd = (dw >> 16)& 0xff;
+
+	dgb_printf("    erase suspend = 0x%02x, resume = 0x%02x, %dus (interval %dus)\n",
+					spidiskinfo.suspend_cmd, spidiskinfo.resume_cmd,
+					spidiskinfo.suspend_us, spidiskinfo.resume_us);
+ #endif
+}
+#endif
+
+
+static DRESULT spi_getinfo(
+	DWORD *memsize,
+	DWORD *id
+)
+{
+	BYTE sfdp[16*4];	// SFDP work
+	DWORD jedecid;
+	UINT dwords;
+	DEF_SPICOMMAND cmd;
+
+	dgb_printf("[SPI] flash device info\n");
+	if (spidiskinfo.spi_if == NULL) return RES_NOTRDY;				// SPI}X^o^ĂȂ 
+
+#if _USE_SPI_WRITE
+	spi_erase_finish();												// s̏Ί҂ 
+#endif
+
+#if _USE_SPI_CONTINUOUSREAD
+	// Aǂݏo[ĥ܂܍ċNꍇɔă[h𔲂 
+	// (AhX3oCg̏ꍇ4oCgڂ[hrbgɂȂ) 
+	if (spidiskinfo.read_continuous) {
+		spi_continuous_exit(spidiskinfo.read_continuous);
+	} else if (spi_buswidth() >= 4) {
+		spi_continuous_exit(4);
+	}
+	spidiskinfo.read_mode_bits = 0xff;
+#endif
+
+	/* JEDEC ID̓ǂݏo */
+
+	spi_setcommand(&cmd, SPI_CMD_GET_JEDECID);
+	cmd.rxbuff = sfdp;
+	cmd.length = 3;
+	spi_burst(&cmd);
+
+	jedecid = (sfdp[0] << 16) | (sfdp[1] << 8) | (sfdp[2] << 0);	// MID, DID2, DID1
+
+	*id = jedecid;
+	dgb_printf("    manufacturer ID = 0x%02x\n    device ID = 0x%04x\n",
+					(jedecid >> 16)& 0xff, jedecid & 0xffff);
+
+#if _USE_SPI_FASTREAD
+	spidiskinfo.read_cmd = SPI_CMD_FAST_READ;			// FAST_READ̃_~[TCN8NbNŒ(JESD216) 
+	spidiskinfo.read_cmd4 = SPI_CMD4_FAST_READ;
+	spidiskinfo.read_dummy = 8;
+#else
+	spidiskinfo.read_cmd = SPI_CMD_READ_DATA;
+	spidiskinfo.read_cmd4 = SPI_CMD4_READ_DATA;
+	spidiskinfo.read_dummy = 0;
+#endif
+	spidiskinfo.read_addr_width = 1;
+	spidiskinfo.read_data_width = 1;
+	spidiskinfo.read_mode_bits = 0xff;
+
+#if _USE_SPI_WRITE
+	spi_setbusytime(&spidiskinfo.erase_time, 0, SPI_ERASE_WAIT_MAX*1000, 1000);
+	spi_setbusytime(&spidiskinfo.program_time, 0, SPI_ERASE_WAIT_MAX*1000, SPI_PROGRAM_POLL_US);
+	spidiskinfo.block_cmd[0] = 0;
+	spidiskinfo.block_cmd[1] = 0;
+	spidiskinfo.suspend_cmd = 0;
+#endif
+
+
+#if _USE_SPI_AUTODETECT
+	/* SFDPwb_ǂݏo */
+
+	spi_read_sfdp(sfdp, 0, 16);
+
+	if (!RIFF_CHECK_ID(&sfdp[0], 'S','F','D','P')) return RES_NOTRDY;	// SFDPɑΉĂȂ 
+	dgb_printf("    SFDP supported\n    parameter table offset = 0x%02x%02x%02x\n",
+					sfdp[14], sfdp[13], sfdp[12]);
+
+
+	/* eʂёΉ@\̎擾 */
+
+	dwords = (sfdp[11] < 16)? sfdp[11] : 16;				// p[^e[uDWORD 
+	if (dwords < 2) return RES_NOTRDY;
+	spi_read_sfdp(sfdp, (sfdp[14] << 16) | (sfdp[13] << 8) | (sfdp[12] << 0), dwords*4);
+
+	if ((sfdp[0] & (3<<0)) != 1) return RES_NOTRDY;			// 4kBZN^ɑΉĂȂ 
+	if (sfdp[1] != SPI_CMD_SECTOR_ERASE) return RES_NOTRDY;
+	dgb_printf("    4kB erase supported\n    erase command set = 0x%02x\n", sfdp[1]);
+
+	if (!((sfdp[2] & (3<<1)) == (0<<1) || (sfdp[2] & (3<<1)) == (1<<1))) return RES_NOTRDY;
+															// 3byteAhbVOɑΉĂȂ 
+	dgb_printf("    3byte addressing supported\n");
+
+	switch (sfdp[7]) {
+		default:
+			return RES_NOTRDY;
+			break;
+
+		case 0x00:	// 16Mbit
+			*memsize = 2*1024*1024;
+			break;
+		case 0x01:	// 32Mbit
+			*memsize = 4*1024*1024;
+			break;
+		case 0x03:	// 64Mbit
+			*memsize = 8*1024*1024;
+			break;
+		case 0x07:	// 128Mbit
+			*memsize = 16*1024*1024;
+			break;
+		case 0x0f:	// 256Mbit
+			*memsize = 32*1024*1024;
+			break;
+		case 0x1f:	// 512Mbit
+			*memsize = 64*1024*1024;
+			break;
+		case 0x3f:	// 1Gbit
+			*memsize = 128*1024*1024;
+			break;
+		case 0x7f:	// 2Gbit
+			*memsize = 256*1024*1024;
+			break;
+	}
+
+ #if _USE_SPI_FASTREAD
+	/* ǂݏo[h̑I */
+
+	if (dwords >= 4) spi_select_readmode(sfdp, dwords, *memsize);
+ #endif
+
+ #if _USE_SPI_WRITE
+	/* EvOԂ̎擾 */
+
+	spi_read_timing(sfdp, dwords);
+ #endif
+#else
+		*memsize = SPI_FLASH_MEMSIZE;
+		dgb_printf("    forced settings\n");
+#endif
+
+	dgb_printf("    flash memory size = %d bytes\n", *memsize);
+	dgb_printf("    read command = 0x%02x/0x%02x (1-%d-%d), %d dummy clocks\n",
+					spidiskinfo.read_cmd, spidiskinfo.read_cmd4,
+					spidiskinfo.read_addr_width, spidiskinfo.read_data_width, spidiskinfo.read_dummy);
+	if (spidiskinfo.read_mode_bits != 0xff) {
+		dgb_printf("    continuous read mode, mode bits = 0x%02x\n", spidiskinfo.read_mode_bits);
+	}
+
+
+	return RES_OK;
+}
+
+
+// f[^ǂݏo(DMA]̏ꍇ͊JnĖ߂) 
+static DRESULT spi_read_async(
+	BYTE *buff,
+	DWORD address,
+	DWORD byte
+)
+{
+	DEF_SPICOMMAND cmd;
+#if _USE_SPI_MAPPEDREAD
+	const BYTE *map;
+#endif
+
+#if _USE_SPI_WRITE
+	// ̏ꍇ̓TXyh邩҂(̃G[͓ǂݏoɂ͉eȂ) 
+	spi_erase_suspend(address, byte);
+#endif
+
+#if _USE_SPI_MAPPEDREAD
+	// }bvǂݏo 
+	map = spi_map();
+	if (map != NULL) {
+		memcpy(buff, map + address, byte);
+		return RES_OK;
+	}
+#endif
+
+	if (address >= 16*1024*1024) {
+		spi_setcommand(&cmd, spidiskinfo.read_cmd4);		// Read 4byte address
+		cmd.addr_bytes = 4;
+	} else {
+		spi_setcommand(&cmd, spidiskinfo.read_cmd);			// Read 3byte address
+		cmd.addr_bytes = 3;
+	}
+	cmd.addr_width = spidiskinfo.read_addr_width;
+	cmd.data_width = spidiskinfo.read_data_width;
+	cmd.dummy_clocks = spidiskinfo.read_dummy;
+	cmd.address = address;
+	cmd.rxbuff = buff;
+	cmd.length = byte;
+
+#if _USE_SPI_CONTINUOUSREAD
+	// Aǂݏo[hł̓R}hoCgȗ(AhX̃oCgςꍇ͔) 
+	if (spidiskinfo.read_mode_bits != 0xff) {
+		if (spidiskinfo.read_continuous && spidiskinfo.read_continuous != cmd.addr_bytes) {
+			spi_continuous_exit(spidiskinfo.read_continuous);
+		}
+		cmd.no_opcode = (spidiskinfo.read_continuous != 0);
+		cmd.mode_bits = spidiskinfo.read_mode_bits;
+
+		if (spi_issue(&cmd, 1)) return RES_ERROR;
+		spidiskinfo.read_continuous = cmd.addr_bytes;
+
+		return RES_OK;
+	}
+#endif
+
+	return spi_issue(&cmd, 1);
+}
+
+// f[^ǂݏoĊ҂ 
+static DRESULT spi_read(
+	BYTE *buff,
+	DWORD address,
+	DWORD byte
+)
+{
+	if (spi_read_async(buff, address, byte)) return RES_ERROR;
+
+	return spi_sync();
+}
+
+
+#if _USE_SPI_WRITE
+// R}h𔭍sĊ҂ɖ߂(spi_erase_finishő҂) 
+static void spi_erase_start(
+	BYTE opcode3,		/* 3byte address command */
+	BYTE opcode4,		/* 4byte address command */
+	DWORD address,
+	DWORD size,
+	DEF_SPIBUSYTIME *bt
+)
+{
+	spi_erase_finish();												// Ȍ̊҂ 
+
+	// ݃Cl[u 
+	spi_command(SPI_CMD_WRITE_ENABLE);								// WP Unlock
+
+	//  
+	spi_command_address(opcode3, opcode4, address, NULL, NULL, 0);
+
+	spidiskinfo.erase_address = address;
+	spidiskinfo.erase_size = size;
+	spidiskinfo.erase_busy = bt;
+	spidiskinfo.erase_state = SPI_ERASE_RUNNING;
+}
+
+// R}h𔭍sĊ҂ 
+static DRESULT spi_erase(
+	BYTE opcode3,		/* 3byte address command */
+	BYTE opcode4,		/* 4byte address command */
+	DWORD address,
+	DWORD size,
+	DEF_SPIBUSYTIME *bt
+)
+{
+	DRESULT res;
+
+	address &= ~(size-1);
+	spi_erase_start(opcode3, opcode4, address, size, bt);
+
+	// ҂ 
+	res = spi_waitbusy(bt);
+	spidiskinfo.erase_size = 0;
+
+	return spi_erase_end(res, address, size);
+}
+
+static DRESULT spi_erase_sector(
+	DWORD address
+)
+{
+	return spi_erase(SPI_CMD_SECTOR_ERASE, SPI_CMD4_SECTOR_ERASE, address, SPI_ERASE_SIZE, &spidiskinfo.erase_time);
+}
+
+// ZN^JnĊ҂ɖ߂ 
+static void spi_erase_sector_start(
+	DWORD address
+)
+{
+	address &= ~(SPI_ERASE_SIZE-1);
+	spi_erase_start(SPI_CMD_SECTOR_ERASE, SPI_CMD4_SECTOR_ERASE, address, SPI_ERASE_SIZE, &spidiskinfo.erase_time);
+}
+
+#if _USE_SPI_BLOCKERASE
+// ubN(block0=32kB / 1=64kB) 
+static DRESULT spi_erase_block(
+	DWORD address,
+	UINT block
+)
+{
+	return spi_erase(spidiskinfo.block_cmd[block], spidiskinfo.block_cmd4[block], address,
+					SPI_BLOCK_SECTORS(block) * SPI_ERASE_SIZE, &spidiskinfo.block_time[block]);
+}
+#endif
+
+
+// y[WbyteoCgvO(y[W܂ȂƁEȂoCg͕ςȂ) 
+static DRESULT spi_program_bytes(
+	const BYTE *buff,	/* Data to be written */
+	DWORD address,
+	UINT byte,
+	BYTE verify			/* 1=Read back and compare */
+)
+{
+	const BYTE *p;
+	BYTE *v, page[SPI_PAGE_SIZE];
+	DRESULT res;
+	UINT n;
+
+	spi_erase_finish();												// s̏̊҂ 
+
+	// ݃Cl[u 
+	spi_command(SPI_CMD_WRITE_ENABLE);								// WP Unlock
+
+	// y[W 
+	spi_command_address(SPI_CMD_PAGE_PROGRAM, SPI_CMD4_PAGE_PROGRAM, address, buff, NULL, byte);
+
+	// ݊҂ 
+	res = spi_waitbusy(&spidiskinfo.program_time);
+	spi_invalidate(address, byte);
+	if (res != RES_OK) {
+		spi_command(SPI_CMD_RESET_ENABLE);							// ^CAEg foCXZbg 
+		spi_command(SPI_CMD_RESET);
+
+		return RES_ERROR;
+	}
+
+	// xt@C 
+	if (!verify) return RES_OK;
+
+	spi_read(page, address, byte);
+	p = buff;
+	v = page;
+	for(n=byte ; n>0 ; n--) {
+		if (*p++ != *v++) break;
+	}
+	if (n != 0) return RES_ERROR;
+
+	return RES_OK;
+}
+
+static DRESULT spi_program_page(
+	const BYTE *buff,	/* Data to be written */
+	DWORD address,
+	BYTE verify			/* 1=Read back and compare */
+)
+{
+	return spi_program_bytes(buff, address & ~(SPI_PAGE_SIZE-1), SPI_PAGE_SIZE, verify);
+}
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Format a physical disk                                                */
+/*-----------------------------------------------------------------------*/
+
+// fBXNZN^̎gp}bvgpς݂̑փZN^̐𓾂(}bvȂEt̏ꍇ-1) 
+static int rsvmap_count(
+	const BYTE *info	/* Diskinfo sector */
+)
+{
+	const BYTE *p;
+	int n;
+
+	p = info + SPI_RSVMAP_OFFSET;
+	if ( !RIFF_CHECK_ID(p, 'r','s','v','m') ) return -1;
+
+	for(n=0,p+=4 ; n<SPI_RSVMAP_COUNT ; n++,p++) {
+		if (*p != 0x00) return n;
+	}
+
+	return -1;
+}
+
+#if _USE_SPI_WRITE
+// gpς݂̑փZN^̐gp}bvɏ(}bvȂ΍쐬) 
+// 0x00ɂoCg͈̔͂vOAvOς݂̃oCg͑蒼Ȃ 
+static DRESULT rsvmap_program(
+	DWORD info_address,	/* Diskinfo sector address */
+	UINT used			/* Number of used reserve sectors */
+)
+{
+	BYTE page[SPI_PAGE_SIZE];
+	DWORD address, offset;
+	UINT i, n, top, end, retry;
+
+	if (used > SPI_RSVMAP_COUNT) used = SPI_RSVMAP_COUNT;
+	n = 0;
+
+	do {
+		offset = SPI_RSVMAP_OFFSET + 4 + n;
+		address = info_address + (offset & ~(SPI_PAGE_SIZE-1));
+		if (spi_read(page, address, SPI_PAGE_SIZE)) return RES_ERROR;
+
+		top = SPI_PAGE_SIZE;
+		end = 0;
+		if ((offset & ~(SPI_PAGE_SIZE-1)) == SPI_RSVMAP_OFFSET && !RIFF_CHECK_ID(page, 'r','s','v','m')) {
+			RIFF_SET_ID(page, 'r','s','v','m');
+			top = 0;
+			end = 4;
+		}
+
+		for(i=offset & (SPI_PAGE_SIZE-1) ; i<SPI_PAGE_SIZE && n<used ; i++,n++) {
+			if (page[i] != 0x00) {
+				page[i] = 0x00;
+				if (i < top) top = i;
+				end = i + 1;
+			}
+		}
+
+		if (top < end) {
+			for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+				if (spi_program_bytes(&page[top], address + top, end - top, 1) == RES_OK) break;
+			}
+			if (retry == 0) {
+				dgb_printf("[!] reserve map program was failed. (0x%08x)\n", address + top);
+				return RES_ERROR;
+			}
+		}
+	} while(n < used);
+
+	return RES_OK;
+}
+#endif
+
+#if _USE_SPI_LOG || _USE_SPI_SATJNL
+#if _USE_SPI_WRITE
+// W[ĩR[h 
+static void ftl_setrecord(
+	BYTE *p,
+	WORD a,
+	WORD b
+)
+{
+	RIFF_SET_WORD(&p[0], a);
+	RIFF_SET_WORD(&p[2], b);
+	RIFF_SET_WORD(&p[4], ~a);
+	RIFF_SET_WORD(&p[6], ~b);
+}
+#endif
+
+// W[ĩR[ho(␔vȂꍇRES_ERROR) 
+static DRESULT ftl_getrecord(
+	const BYTE *p,
+	WORD *a,
+	WORD *b
+)
+{
+	*a = RIFF_GET_WORD(&p[0]);
+	*b = RIFF_GET_WORD(&p[2]);
+
+	if ((WORD)((RIFF_GET_WORD(&p[4])) ^ *a) != 0xffff || (WORD)((RIFF_GET_WORD(&p[6])) ^ *b) != 0xffff) return RES_ERROR;
+
+	return RES_OK;
+}
+
+#if _USE_SPI_WRITE
+// W[ĩR[hvO(address̓R[h̃AhX) 
+// R[h8oCg𑗂Ay[Ŵق̃R[h̓vOȂ 
+static DRESULT jnl_program(
+	DWORD address,
+	WORD a,
+	WORD b
+)
+{
+	BYTE rec[SPI_JNL_RECORD_SIZE];
+
+	ftl_setrecord(rec, a, b);
+
+	return spi_program_bytes(rec, address, SPI_JNL_RECORD_SIZE, 1);
+}
+#endif
+#endif
+
+
+#if _USE_SPI_FORMAT
+// fBXNe[u(ext̓o[W2̊gtB[h8oCgANULL̏ꍇ̓o[W1) 
+static DRESULT format_diskinfo(
+	DWORD diskinfo_sector,
+	WORD all_sector_count,
+	DWORD startaddr,
+	WORD rsv_top_sector,
+	WORD sat_top_sector,
+	const BYTE *ext
+)
+{
+	DWORD address;
+	UINT n, retry;
+	BYTE buff[SPI_PAGE_SIZE];
+
+	for(n=0 ; n<SPI_PAGE_SIZE ; n++) buff[n] = 0xff;
+
+	RIFF_SET_ID(&buff[0], 'R','I','F','F');
+	RIFF_SET_DWORD(&buff[4], 4+8+(ext ? 24 : 16));
+	RIFF_SET_ID(&buff[8], 'D','I','S','K');
+
+	RIFF_SET_ID(&buff[12], 'i','n','f','o');
+	RIFF_SET_DWORD(&buff[16], (ext ? 24 : 16));
+
+	RIFF_SET_DWORD(&buff[20], (ext ? 2 : 1));						// + 0 DW VERSION
+	RIFF_SET_DWORD(&buff[24], all_sector_count * SPI_ERASE_SIZE);	// + 4 DW DISKSIZE
+	RIFF_SET_DWORD(&buff[28], startaddr);							// + 8 DW DISK_TOPADDR
+	RIFF_SET_WORD(&buff[32], rsv_top_sector);						// +12 W  RSV_TOP_SECTOR
+	RIFF_SET_WORD(&buff[34], sat_top_sector);						// +14 W  SAT_TOP_SECTOR
+	if (ext) {
+		for(n=0 ; n<8 ; n++) buff[36+n] = ext[n];					// +16 W  JNL_TOP_SECTOR / +18 W JNL_SECTOR_COUNT
+	}																// +20 W  CKP_SECTOR_COUNT / +22 B MODE
+
+	address = diskinfo_sector * SPI_ERASE_SIZE;
+
+	for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+		if (spi_erase_sector(address) == RES_OK) break;
+	}
+	if (retry == 0) {
+		dgb_printf("[!] diskinfo sector erase was failed. (0x%08x)\n", address);
+		return RES_ERROR;
+	}
+
+	for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+		if (spi_program_page(buff, address, 1) == RES_OK) break;
+	}
+	if (retry == 0) {
+		dgb_printf("[!] diskinfo sector program was failed. (0x%08x)\n", address);
+		return RES_ERROR;
+	}
+
+	return RES_OK;
+}
+
+#if _USE_SPI_LOG
+// y[W 
+static DRESULT format_page(
+	const BYTE *buff,
+	DWORD address
+)
+{
+	UINT retry;
+
+	for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+		if (spi_program_page(buff, address, 1) == RES_OK) return RES_OK;
+	}
+
+	dgb_printf("\n[!] page program was failed. (0x%08x)\n", address);
+	return RES_ERROR;
+}
+
+// O\̃{[쐬 
+// ZN^̓f[^(󂫃ZN^܂)E`FbN|Cg~2EW[ȉɔzu 
+// `FbN|Cg͕ZN^̏ԃe[u(WORD~f[^ZN^)ƃy[WEn܂LBAϊe[u(WORD~_ZN^) 
+static DRESULT ftl_format(
+	DWORD diskinfo_sector,
+	DWORD startaddr,
+	WORD all_sector_count,
+	WORD rsv_count
+)
+{
+	WORD data_sector_count, dat_sector_count, spare_sector_count, ckp_sector_count, jnl_sector_count;
+	WORD sat_top_sector, jnl_top_sector, phy_sector, lba_sector, good_count;
+	DWORD address, table_address;
+	UINT n, retry;
+	BYTE buff[SPI_PAGE_SIZE], ext[8];
+
+	/* p[^vZ */
+
+	jnl_sector_count = (SPI_JOURNAL_SECTORS < 2) ? 2 : SPI_JOURNAL_SECTORS;
+	ckp_sector_count = ((all_sector_count * 4 + SPI_PAGE_SIZE) / SPI_ERASE_SIZE) + 1;
+	data_sector_count = all_sector_count - ckp_sector_count * 2 - jnl_sector_count;
+
+	if (rsv_count == 0) {
+		spare_sector_count = (data_sector_count / 32) + 10;
+	} else {
+		spare_sector_count = rsv_count;
+	}
+
+	if (data_sector_count < spare_sector_count + 128) {
+		dgb_printf("[!] format parameter error\n");
+		return RES_PARERR;
+	}
+
+	dat_sector_count = data_sector_count - spare_sector_count;
+	sat_top_sector = data_sector_count;
+	jnl_top_sector = sat_top_sector + ckp_sector_count * 2;
+
+	dgb_printf("    log-structured volume\n    data sector count = %d (spare %d)\n", data_sector_count, spare_sector_count);
+	dgb_printf("    checkpoint top sector = %d (%d sectors x2)\n    journal top sector = %d (%d sectors)\n",
+					sat_top_sector, ckp_sector_count, jnl_top_sector, jnl_sector_count);
+
+
+	/* `FbN|CgƃW[ȉ */
+
+	address = startaddr + sat_top_sector * SPI_ERASE_SIZE;
+
+	for(n=ckp_sector_count * 2 + jnl_sector_count ; n>0 ; n--) {
+		for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+			if (spi_erase_sector(address) == RES_OK) break;
+		}
+		if (retry == 0) {
+			dgb_printf("[!] checkpoint/journal erase was failed. (0x%08x)\n", address);
+			return RES_ERROR;
+		}
+
+		address += SPI_ERASE_SIZE;
+	}
+
+
+	/* ZN^eXgƕZN^̏ԃe[u쐬(sǃZN^0xffff̂܂) */
+
+	dgb_printf("    format");
+	table_address = startaddr + sat_top_sector * SPI_ERASE_SIZE;
+	good_count = 0;
+
+	for(n=0 ; n<SPI_PAGE_SIZE ; n++) buff[n] = 0xff;
+
+	for(phy_sector=0 ; phy_sector<data_sector_count ; ) {
+		address = startaddr + phy_sector * SPI_ERASE_SIZE;
+
+		for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+			if (spi_erase_sector(address) == RES_OK) break;
+		}
+		if (retry) {
+			n = (phy_sector & (SPI_PAGE_SIZE/2-1)) * 2;
+			buff[n] = 0;
+			buff[n+1] = 0;
+			good_count++;
+		}
+
+		phy_sector++;
+
+		if ( (phy_sector & (SPI_PAGE_SIZE/2-1)) == 0 || phy_sector == data_sector_count) {
+			if (format_page(buff, table_address)) return RES_ERROR;
+			table_address += SPI_PAGE_SIZE;
+
+			for(n=0 ; n<SPI_PAGE_SIZE ; n++) buff[n] = 0xff;
+			dgb_printf(".");
+		}
+	}
+
+	if (good_count < dat_sector_count) {
+		dgb_printf("\n[!] too many bad sectors.\n");
+		return RES_ERROR;
+	}
+
+
+	/* LBAϊe[u쐬(Ǖi̕ZN^Ɋ蓖Ă) */
+
+	address = startaddr + sat_top_sector * SPI_ERASE_SIZE;
+	phy_sector = 0;
+
+	for(lba_sector=0 ; lba_sector<dat_sector_count ; ) {
+		while(1) {
+			if (spi_read(ext, address + phy_sector * 2, 2)) return RES_ERROR;
+			if (ext[0] == 0 && ext[1] == 0) break;
+			phy_sector++;
+		}
+
+		n = (lba_sector & (SPI_PAGE_SIZE/2-1)) * 2;
+		buff[n] = phy_sector & 0xff;
+		buff[n+1] = (phy_sector >> 8) & 0xff;
+
+		phy_sector++;
+		lba_sector++;
+
+		if ( (lba_sector & (SPI_PAGE_SIZE/2-1)) == 0 || lba_sector == dat_sector_count) {
+			if (format_page(buff, table_address)) return RES_ERROR;
+			table_address += SPI_PAGE_SIZE;
+
+			for(n=0 ; n<SPI_PAGE_SIZE ; n++) buff[n] = 0xff;
+			dgb_printf(".");
+		}
+	}
+
+
+	/* W[i쐬(V[PXԍ1A`FbN|Cg0Jn) */
+
+	ftl_setrecord(buff, 1, 0);
+	if (format_page(buff, startaddr + jnl_top_sector * SPI_ERASE_SIZE)) return RES_ERROR;
+
+	dgb_printf("done\n");
+
+
+	/* fBXNe[u쐬 */
+
+	RIFF_SET_WORD(&ext[0], jnl_top_sector);
+	RIFF_SET_WORD(&ext[2], jnl_sector_count);
+	RIFF_SET_WORD(&ext[4], ckp_sector_count);
+	ext[6] = SPIDISK_FORMAT_LOG;
+	ext[7] = 0xff;
+
+	return format_diskinfo(diskinfo_sector, all_sector_count, startaddr, dat_sector_count, sat_top_sector, ext);
+}
+#endif
+
+DRESULT spidisk_format(
+	DWORD disksize,
+	WORD rsv_count,
+	BYTE mode
+)
+{
+	DWORD memsize, id, diskinfo_sector, startaddr;
+	WORD rsv_top_sector, sat_top_sector, jnl_top_sector;
+	WORD all_sector_count, rsv_sector_count, sat_sector_count, dat_sector_count, jnl_sector_count;
+	DWORD address, sat_address;
+	WORD lba_sector, phy_sector, rsv_sector;
+	UINT n, retry;
+	BYTE buff[SPI_PAGE_SIZE];
+#if _USE_SPI_SATJNL
+	DWORD jnl_address;
+	BYTE ext[8];
+#endif
+
+	/* p[^vZ */
+
+	if (spi_getinfo(&memsize, &id)) return RES_NOTRDY;
+
+	dgb_printf("[DISK] spi disk format\n");
+
+	if (disksize == 0) disksize = memsize;
+	if (disksize < 1*1024*1024) {
+		dgb_printf("[!] format parameter error\n");
+		return RES_PARERR;
+	}
+
+	all_sector_count = (disksize / SPI_ERASE_SIZE) - 1;
+
+	if (memsize < (all_sector_count + 1) * SPI_ERASE_SIZE) {
+		dgb_printf("[!] format parameter error\n");
+		return RES_PARERR;
+	}
+
+	spidisk = NULL;													// disk_initializeŃ{[ǂݒ 
+
+#if _USE_SPI_LOG
+	if (mode == SPIDISK_FORMAT_LOG) {
+		return ftl_format((memsize / SPI_ERASE_SIZE) - 1, memsize - (all_sector_count + 1) * SPI_ERASE_SIZE,
+							all_sector_count, rsv_count);
+	}
+#endif
+	if (mode != SPIDISK_FORMAT_STATIC) return RES_PARERR;
+
+	if (rsv_count == 0) {
+		rsv_sector_count = (all_sector_count / 32) + 10;
+	} else {
+		rsv_sector_count = rsv_count;
+	}
+
+	// փZN^̊蓖Ăׂ͂ăW[iɎĉŁAփZN^̐̃R[h悤ɂ 
+	// vOɎsR[h͎gȂ߁A1̊蓖ĂɂĎs񐔕̃R[h 
+	jnl_sector_count = _USE_SPI_SATJNL ? (rsv_sector_count * SPI_RETRY_COUNT / SPI_JNL_RECORDS) + 1 : 0;
+
+	sat_sector_count = ((all_sector_count - rsv_sector_count - jnl_sector_count)*2 / SPI_ERASE_SIZE) + 1;
+	dat_sector_count = all_sector_count - rsv_sector_count - sat_sector_count - jnl_sector_count;
+
+	if (dat_sector_count < 128) {
+		dgb_printf("[!] format parameter error\n");
+		return RES_PARERR;
+	}
+
+	diskinfo_sector = (memsize / SPI_ERASE_SIZE) - 1;
+	startaddr = memsize - (all_sector_count + 1) * SPI_ERASE_SIZE;
+	jnl_top_sector = all_sector_count - jnl_sector_count;
+	sat_top_sector = jnl_top_sector - sat_sector_count;
+	rsv_top_sector = sat_top_sector - rsv_sector_count;
+
+
+	dgb_printf("    diskinfo offset = 0x%08x (sector %d)\n",
 					diskinfo_sector * SPI_ERASE_SIZE, diskinfo_sector);
 	dgb_printf("    diskimage top offset = 0x%08x (sector %d)\n    rsv top sector = %d, offset = 0x%08x\n",
 					startaddr , startaddr / SPI_ERASE_SIZE,
 					rsv_top_sector, startaddr + rsv_top_sector * SPI_ERASE_SIZE);
 	dgb_printf("    sat top sector = %d, offset = 0x%08x\n",
 					sat_top_sector, startaddr + sat_top_sector * SPI_ERASE_SIZE);
+	if (jnl_sector_count) {
+		dgb_printf("    journal top sector = %d (%d sectors)\n", jnl_top_sector, jnl_sector_count);
+	}
+
+
+	/* ZN^eXgLBAϊe[u쐬 */
+
+	dgb_printf("    format");
+	address = startaddr + sat_top_sector * SPI_ERASE_SIZE;
+
+	for(n=sat_sector_count + jnl_sector_count ; n>0 ; n--) {
+		for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+			if (spi_erase_sector(address) == RES_OK) break;
+		}
+		if (retry == 0) {
+			dgb_printf("\n[!] sector allocation table erase was failed. (0x%08x)\n", address);
+			return RES_ERROR;
+		}
+
+		address += SPI_ERASE_SIZE;
+	}
+
+
+	lba_sector = 0;
+	rsv_sector = rsv_top_sector;
+	sat_address = startaddr + sat_top_sector * SPI_ERASE_SIZE;
+#if _USE_SPI_SATJNL
+	jnl_address = startaddr + jnl_top_sector * SPI_ERASE_SIZE;
+#endif
+
+	for(n=0 ; n<SPI_PAGE_SIZE ; n++) buff[n] = 0xff;
+
+	do {
+		phy_sector = lba_sector;
+
+		while(1) {
+			address = startaddr + phy_sector * SPI_ERASE_SIZE;
+
+			for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+				if (spi_erase_sector(address) == RES_OK) break;
+			}
+			if (retry) {
+				break;
+			} else {
+				phy_sector = rsv_sector++;
+
+				if (phy_sector >= sat_top_sector) {
+					dgb_printf("\n[!] remap lba %d was failed.\n", lba_sector);
+					return RES_ERROR;
+				}
+
+#if _USE_SPI_SATJNL
+				// tH[}bg̑փZN^W[iɋL^ 
+				for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+					n = (jnl_program(jnl_address, lba_sector, phy_sector) == RES_OK);
+					jnl_address += SPI_JNL_RECORD_SIZE;
+					if (n) break;
+				}
+				if (retry == 0) {
+					dgb_printf("\n[!] journal program was failed. (0x%08x)\n", jnl_address);
+					return RES_ERROR;
+				}
+#endif
+			}
+		}
+
+		n = (lba_sector & (SPI_PAGE_SIZE/2-1)) * 2;
+		buff[n] = phy_sector & 0xff;
+		buff[n+1] = (phy_sector >> 8) & 0xff;
+
+		lba_sector++;
+
+		if ( (lba_sector & (SPI_PAGE_SIZE/2-1)) == 0 || lba_sector == dat_sector_count) {
+			for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+				if (spi_program_page(buff, sat_address, 1) == RES_OK) break;
+			}
+			if (retry == 0) {
+				dgb_printf("\n[!] sector allocation table program was failed. (0x%08x)\n", sat_address);
+				return RES_ERROR;
+			}
+
+			sat_address += SPI_PAGE_SIZE;
+
+			for(n=0 ; n<SPI_PAGE_SIZE ; n++) buff[n] = 0xff;
+			dgb_printf(".");
+		}
+
+	} while(lba_sector < dat_sector_count);
+
+	dgb_printf("done\n");
+
+
+	/* fBXNe[u쐬 */
+
+#if _USE_SPI_SATJNL
+	RIFF_SET_WORD(&ext[0], jnl_top_sector);
+	RIFF_SET_WORD(&ext[2], jnl_sector_count);
+	RIFF_SET_WORD(&ext[4], 0);
+	ext[6] = SPIDISK_FORMAT_STATIC;
+	ext[7] = 0xff;
+
+	return format_diskinfo(diskinfo_sector, all_sector_count, startaddr, rsv_top_sector, sat_top_sector, ext);
+#else
+	if (format_diskinfo(diskinfo_sector, all_sector_count, startaddr, rsv_top_sector, sat_top_sector, NULL)) return RES_ERROR;
+
+	return rsvmap_program(diskinfo_sector * SPI_ERASE_SIZE, rsv_sector - rsv_top_sector);
+#endif
+}
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Initialize a physical disk                                            */
+/*-----------------------------------------------------------------------*/
+
+static DRESULT spidisk_init(void)
+{
+	DWORD memsize, id, infosector;
+	DWORD disksize, startaddr, version;
+	WORD rsv_top_sector, sat_top_sector;
+	WORD all_sector_count, rsv_sector_count, sat_sector_count, dat_sector_count, jnl_sector_count;
+	BYTE buff[SPI_ERASE_SIZE];
+	BYTE mode;
+	int rsv_used;
+	UINT i;
+
+	/* fBXNe[uǂݏo */
+
+	if (spi_getinfo(&memsize, &id)) return RES_NOTRDY;
+
+	infosector = (memsize / SPI_ERASE_SIZE) - 1;
+	spi_read(buff, infosector * SPI_ERASE_SIZE, SPI_ERASE_SIZE);
+
+	dgb_printf("[INFO] diskinfo offset = 0x%08x (sector %d)\n",
+					infosector * SPI_ERASE_SIZE, infosector);
+
+	if ( !(RIFF_CHECK_ID(&buff[8], 'D','I','S','K') && RIFF_CHECK_ID(&buff[12], 'i','n','f','o')) ) {
+		dgb_printf("    disk infomation data is not found.\n");
+		return RES_NOTRDY;
+	}
+
+	version = RIFF_GET_DWORD(&buff[20]);			// + 0 DW VERSION
+	disksize  = RIFF_GET_DWORD(&buff[24]);			// + 4 DW DISKSIZE
+	startaddr = RIFF_GET_DWORD(&buff[28]);			// + 8 DW DISK_TOPADDR
+	rsv_top_sector = RIFF_GET_WORD(&buff[32]);		// +12  W RSV_TOP_SECTOR
+	sat_top_sector = RIFF_GET_WORD(&buff[34]);		// +14  W SAT_TOP_SECTOR
+	mode = (version >= 2) ? buff[42] : SPIDISK_FORMAT_STATIC;	// +22  B MODE
+
+	dgb_printf("    signature :");
+	for(i=0 ; i<8 ; i++) dgb_printf(" '%c'", buff[8+i]);
+	dgb_printf("\n    version : %d\n", version);
+
+	if (mode != SPIDISK_FORMAT_STATIC && !(_USE_SPI_LOG && mode == SPIDISK_FORMAT_LOG)) {
+		dgb_printf("    volume mode %d is not supported.\n", mode);
+		return RES_NOTRDY;
+	}
+
+	// փZN^̃W[iŒ芄蓖Ẵ{[ 
+	jnl_sector_count = (version >= 2 && mode == SPIDISK_FORMAT_STATIC)? RIFF_GET_WORD(&buff[38]) : 0;
+
+	if (jnl_sector_count && !_USE_SPI_SATJNL) {
+		dgb_printf("    sat journal is not supported.\n");
+		return RES_NOTRDY;
+	}
+
+
+	/* eBXN\̂̏ */
+
+	all_sector_count = disksize / SPI_ERASE_SIZE;
+	rsv_sector_count = sat_top_sector - rsv_top_sector;
+	sat_sector_count = ((all_sector_count - rsv_sector_count - jnl_sector_count)*2 / SPI_ERASE_SIZE) + 1;
+	dat_sector_count = rsv_top_sector;
+
+	spidisk = &spidiskinfo;
+
+	spidisk->storage_size = disksize;
+	spidisk->top_address = startaddr;
+	spidisk->rsv_top_sector = rsv_top_sector;
+	spidisk->sat_top_sector = sat_top_sector;
+
+	spidisk->pba_count = all_sector_count;
+	spidisk->rsv_count = rsv_sector_count;
+	spidisk->lba_count = dat_sector_count;
+
+#if _USE_SPI_SATCACHE
+	spiff_free(spidisk->lba_table);									// tH[}bgÕ{[̃e[u 
+#endif
+	spidisk->lba_table = NULL;
+	spidisk->info_address = infosector * SPI_ERASE_SIZE;
+	spidisk->mode = mode;
+
+	// փZN^̎gp}bv΍ŌɊ蓖ĂꂽփZN^킩(Ȃꍇ͍ŏ̑֏SAT) 
+	// W[i{[ł̓}Eg̃W[i̍Đŋ߂ 
+	spidisk->last_rsv_sector = 0;
+	if (mode == SPIDISK_FORMAT_STATIC && jnl_sector_count == 0) {
+		rsv_used = rsvmap_count(buff);
+		if (rsv_used >= 0) spidisk->last_rsv_sector = rsv_top_sector + rsv_used - 1;
+	}
+#if _USE_SPI_LOG || _USE_SPI_SATJNL
+	spidisk->jnl_count = 0;
+#endif
+#if _USE_SPI_SATJNL
+	if (jnl_sector_count) {
+		spidisk->jnl_top_sector = RIFF_GET_WORD(&buff[36]);		// +16  W JNL_TOP_SECTOR
+		spidisk->jnl_count = jnl_sector_count;					// +18  W JNL_SECTOR_COUNT
+	}
+#endif
+#if _USE_SPI_LOG
+	spiff_free(spidisk->phy_table);
+	spiff_free(spidisk->used_map);
+	spidisk->phy_table = NULL;
+	spidisk->used_map = NULL;
+
+	if (mode == SPIDISK_FORMAT_LOG) {
+		spidisk->data_count = sat_top_sector;
+		spidisk->jnl_top_sector = RIFF_GET_WORD(&buff[36]);		// +16  W JNL_TOP_SECTOR
+		spidisk->jnl_count = RIFF_GET_WORD(&buff[38]);			// +18  W JNL_SECTOR_COUNT
+		spidisk->ckp_count = RIFF_GET_WORD(&buff[40]);			// +20  W CKP_SECTOR_COUNT
+	}
+#endif
+
+	spidisk->verify.policy = SPI_VERIFY_POLICY;
+	spidisk->verify.interval = SPI_VERIFY_INTERVAL;
+	spidisk->verify_phase = 0;
+#if SPI_SCRUB_QUEUE > 0
+	spidisk->scrub_count = 0;
+	spidisk->scrub_failed_count = 0;
+#endif
+#if SPI_ERASE_POOL > 0
+	spidisk->pool_dirty_count = 0;
+	spidisk->pool_clean_count = 0;
+#endif
+#if SPI_WBCACHE_COUNT > 0
+	spidisk->wb_clock = 0;
+	for(i=0 ; i<SPI_WBCACHE_COUNT ; i++) spidisk->wb_lba[i] = 0xffffffff;
+#endif
+
+	dgb_printf("    diskimage top offset = 0x%08x (sector %d)\n    reserve sector top = %d\n    sat sector top = %d\n",
+					startaddr, startaddr / SPI_ERASE_SIZE,
+					spidisk->rsv_top_sector, spidisk->sat_top_sector);
+
+	dgb_printf("    physical sector count = %d\n    reserve sector count = %d\n    logical sector count = %d\n    sat sector count = %d\n",
+					spidisk->pba_count, spidisk->rsv_count, spidisk->lba_count,
+					sat_sector_count);
+
+	return RES_OK;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Access a physical sector                                              */
+/*-----------------------------------------------------------------------*/
+
+static DRESULT read_physector(
+	BYTE *buff,			/* Data buffer to store read data */
+	DWORD sector		/* Sector address in Physical */
+)
+{
+	DWORD address;
+
+	if (spidisk == NULL) return RES_NOTRDY;
+	address = spidisk->top_address + sector * SPI_ERASE_SIZE;
+
+	return spi_read(buff, address, SPI_ERASE_SIZE);
+}
+
+// ZN^̓ǂݏoJn(spi_syncő҂) 
+static DRESULT read_physector_async(
+	BYTE *buff,			/* Data buffer to store read data */
+	DWORD sector		/* Sector address in Physical */
+)
+{
+	DWORD address;
+
+	if (spidisk == NULL) return RES_NOTRDY;
+	address = spidisk->top_address + sector * SPI_ERASE_SIZE;
+
+	return spi_read_async(buff, address, SPI_ERASE_SIZE);
+}
+
+
+#if _USE_SPI_WRITE
+#define SPI_PAGE_ALL			((WORD)((1 << SPI_ERASEPAGE_COUNT) - 1))	// ZN^̑Sy[W̃rbg}bv 
+
+// CRC-16(CCITT)vZ 
+static WORD spi_crc16(
+	WORD crc,
+	const BYTE *buff,
+	DWORD byte
+)
+{
+	static const WORD crctable[16] = {
+		0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+		0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef
+	};
+
+	while(byte--) {
+		crc = (crc << 4) ^ crctable[(crc >> 12) ^ (*buff >> 4)];
+		crc = (crc << 4) ^ crctable[(crc >> 12) ^ (*buff & 0x0f)];
+		buff++;
+	}
+
+	return crc;
+}
+
+// ZN^ǂݏoCRCr 
+static DRESULT verify_physector(
+	DWORD sector,		/* Sector address in Offset */
+	WORD crc			/* CRC of the data written */
+)
+{
+	BYTE page[SPI_PAGE_SIZE];
+	DWORD address;
+	WORD c;
+	UINT i;
+#if _USE_SPI_MAPPEDREAD
+	const BYTE *map;
+#endif
+
+	address = spidisk->top_address + sector * SPI_ERASE_SIZE;
+	c = 0xffff;
+	spidisk->stat.verify_count++;
+	spi_erase_suspend(address, SPI_ERASE_SIZE);
+
+#if _USE_SPI_MAPPEDREAD
+	// }bvǂݏoł̓EBhE璼ڌvZ 
+	map = spi_map();
+	if (map != NULL) {
+		c = spi_crc16(c, map + address, SPI_ERASE_SIZE);
+	} else
+#endif
+	{
+		for(i=SPI_ERASEPAGE_COUNT ; i>0 ; i--) {
+			if (spi_read(page, address, SPI_PAGE_SIZE)) return RES_ERROR;
+			c = spi_crc16(c, page, SPI_PAGE_SIZE);
+			address += SPI_PAGE_SIZE;
+		}
+	}
+
+	if (c != crc) {
+		dgb_printf("[!] verify error sector %d\n", sector);
+		spidisk->stat.verify_error_count++;
+		return RES_ERROR;
+	}
+
+	return RES_OK;
+}
+
+#if SPI_SCRUB_QUEUE > 0
+// XNu҂̃ZN^xt@C 
+// G[ɂȂZN^scrub_failedɋL^ACTRL_SYNCőւ(ݒ̃ZN^̃G[ɂ͂Ȃ) 
+static void scrub_physector(void)
+{
+	DWORD sector;
+	UINT i;
+
+	for(i=0 ; i<spidisk->scrub_count ; i++) {
+		sector = spidisk->scrub_sector[i];
+		if (verify_physector(sector, spidisk->scrub_crc[i]) == RES_OK) continue;
+
+		spidisk->stat.scrub_error_count++;
+		spidisk->stat.scrub_error_sector = sector;
+		if (spidisk->scrub_failed_count < SPI_SCRUB_QUEUE) {
+			spidisk->scrub_failed[spidisk->scrub_failed_count++] = sector;
+		}
+	}
+	spidisk->scrub_count = 0;
+	spi_erase_resume();
+}
+
+// XNu҂ZN^菜 
+static void scrub_drop(
+	DWORD sector,		/* Sector address in Offset */
+	UINT count
+)
+{
+	UINT i,n;
+
+	for(i=n=0 ; i<spidisk->scrub_count ; i++) {
+		if (spidisk->scrub_sector[i] - sector >= count) {
+			spidisk->scrub_sector[n] = spidisk->scrub_sector[i];
+			spidisk->scrub_crc[n] = spidisk->scrub_crc[i];
+			n++;
+		}
+	}
+	spidisk->scrub_count = n;
+}
+
+// ZN^XNu҂ɉ(t̏ꍇ͐ɃXNu) 
+static void scrub_push(
+	DWORD sector,		/* Sector address in Offset */
+	WORD crc
+)
+{
+	scrub_drop(sector, 1);
+	if (spidisk->scrub_count >= SPI_SCRUB_QUEUE) scrub_physector();
+
+	spidisk->scrub_sector[spidisk->scrub_count] = sector;
+	spidisk->scrub_crc[spidisk->scrub_count] = crc;
+	spidisk->scrub_count++;
+}
+#endif
+
+// ZN^ςׂ݂(ς݂ȂRES_OK) 
+static DRESULT blank_physector(
+	DWORD sector		/* Sector address in Offset */
+)
+{
+	BYTE page[SPI_PAGE_SIZE];
+	DWORD address;
+	UINT i,n;
+
+	address = spidisk->top_address + sector * SPI_ERASE_SIZE;
+
+	// f[^͐擪珑̂Ō̃y[W璲ׂ 
+	for(i=SPI_ERASEPAGE_COUNT ; i>0 ; i--) {
+		if (spi_read(page, address + (i-1) * SPI_PAGE_SIZE, SPI_PAGE_SIZE)) return RES_ERROR;
+		for(n=0 ; n<SPI_PAGE_SIZE && page[n] == 0xff ; n++);
+		if (n < SPI_PAGE_SIZE) return RES_ERROR;
+	}
+
+	return RES_OK;
+}
+
+#if _USE_SPI_ERASEPOOL
+// ZN^̃Xg菜(ꍇ1Ԃ) 
+static int pool_remove(
+	WORD *list,
+	WORD *count,
+	DWORD sector
+)
+{
+	UINT i;
+
+	for(i=0 ; i<*count ; i++) {
+		if (list[i] == sector) {
+			list[i] = list[--(*count)];
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+// ރZN^v[o(҂͎Aς݂ꍇ1Ԃ) 
+static int pool_take(
+	DWORD sector		/* Sector address in Offset */
+)
+{
+	pool_remove(spidisk->pool_dirty, &spidisk->pool_dirty_count, sector);
+
+	return pool_remove(spidisk->pool_clean, &spidisk->pool_clean_count, sector);
+}
+
+// gȂȂZN^҂ɉ(v[t̏ꍇ͏Ȃ) 
+static void pool_discard(
+	DWORD sector		/* Sector address in Offset */
+)
+{
+	UINT i;
+
+	if (spidisk->pool_dirty_count >= SPI_ERASE_POOL) return;
+
+	for(i=0 ; i<spidisk->pool_dirty_count ; i++) {
+		if (spidisk->pool_dirty[i] == sector) return;
+	}
+	for(i=0 ; i<spidisk->pool_clean_count ; i++) {
+		if (spidisk->pool_clean[i] == sector) return;
+	}
+
+	spidisk->pool_dirty[spidisk->pool_dirty_count++] = sector;
+}
+
+// ҂̃ZN^őlimit(0=ׂ)ďς݂ɂ(Ō̏͊҂ɖ߂) 
+// ZN^Ԃ 
+static DWORD pool_idle(
+	DWORD limit
+)
+{
+	DWORD sector, n;
+
+	for(n=0 ; spidisk->pool_dirty_count > 0 && (limit == 0 || n < limit) ; ) {
+		sector = spidisk->pool_dirty[--spidisk->pool_dirty_count];
+
+		spi_erase_finish();
+		if (blank_physector(sector) != RES_OK) {
+ #if SPI_SCRUB_QUEUE > 0
+			scrub_drop(sector, 1);
+ #endif
+			spi_erase_sector_start(spidisk->top_address + sector * SPI_ERASE_SIZE);
+			spidisk->stat.trim_erase_count++;
+			n++;
+		}
+
+		if (spidisk->pool_clean_count < SPI_ERASE_POOL) {
+			spidisk->pool_clean[spidisk->pool_clean_count++] = sector;
+		}
+	}
+
+	return n;
+}
+#endif
+
+// ς݂̕ZN^ɃvO(pages̓vOy[W̃rbg}bv) 
+static DRESULT program_physector(
+	const BYTE *buff,	/* Data to be written */
+	DWORD sector,		/* Sector address in Offset */
+	WORD pages			/* Bitmap of pages to be programmed */
+)
+{
+	const BYTE *p;
+	DWORD address;
+	BYTE policy, verify;
+	UINT i,n,retry;
+
+	if (spidisk == NULL) return RES_NOTRDY;
+	address = spidisk->top_address + sector * SPI_ERASE_SIZE;
+	policy = spidisk->verify.policy;
+
+	for(p=buff,i=SPI_ERASEPAGE_COUNT ; i>0 ; i--, pages >>= 1) {
+		// SoCg0xff̃y[W̓vOExt@CȂ(ς݂̃y[W̓e͕ςȂ) 
+		if (pages & 1) {
+			for(n=0 ; n<SPI_PAGE_SIZE && p[n] == 0xff ; n++);
+			if (n == SPI_PAGE_SIZE) {
+				pages &= ~1;
+				spidisk->stat.blank_page_count++;
+			}
+		}
+		if (pages & 1) {
+			verify = 0;
+			if (policy == SPIDISK_VERIFY_FULL) {
+				verify = 1;
+			} else if (policy == SPIDISK_VERIFY_SAMPLED && ++spidisk->verify_phase >= spidisk->verify.interval) {
+				spidisk->verify_phase = 0;
+				verify = 1;
+			}
 
+			for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+				if (spi_program_page(p, address, verify) == RES_OK) break;
+			}
+			if (retry == 0) {
+				spidisk->stat.verify_error_count++;
+				return RES_ERROR;
+			}
 
-	/* ZN^eXgLBAϊe[u쐬 */
+			spidisk->stat.program_count++;
+			if (verify) spidisk->stat.verify_count++;
+		} else {
+			spidisk->stat.elide_bytes += SPI_PAGE_SIZE;
+		}
 
-	dgb_printf("    format");
-	address = startaddr + sat_top_sector * SPI_ERASE_SIZE;
+		p += SPI_PAGE_SIZE;
+		address += SPI_PAGE_SIZE;
+	}
 
-	for(n=sat_sector_count ; n>0 ; n--) {
-		for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
-			if (spi_erase_sector(address) == RES_OK) break;
-		}
-		if (retry == 0) {
-			dgb_printf("\n[!] sector allocation table erase was failed. (0x%08x)\n", address);
-			return RES_ERROR;
+	// ZN^Pʂ̃xt@C 
+	if (policy == SPIDISK_VERIFY_CRC) {
+		return verify_physector(sector, spi_crc16(0xffff, buff, SPI_SECTOR_SIZE));
+	}
+#if SPI_SCRUB_QUEUE > 0
+	if (policy == SPIDISK_VERIFY_NONE) {
+		scrub_push(sector, spi_crc16(0xffff, buff, SPI_SECTOR_SIZE));
+	}
+#endif
+
+	return RES_OK;
+}
+
+// ݃f[^ƕZN^݂̌̓er 
+// *diffɓeقȂy[W̃rbg}bvԂ 
+// ɃvOłꍇRES_OKAKvȃy[W_RES_ERRORԂ 
+// (SoCg0xff)̃y[Wւ̃vO͏1ڂ̃vOȂ̂ŏɏȂŏ 
+// (t@Cւ̒ǋL̂悤ɁAς݂̃y[Wς鏑݂̓y[W̃vOōς) 
+// ԂłȂy[ẂA_USE_SPI_SKIPERASE1ŏ݃f[^0ɂrbg̏ꍇɏȂŏ 
+static DRESULT compare_physector(
+	const BYTE *buff,	/* Data to be written */
+	DWORD sector,		/* Sector address in Offset */
+	WORD *diff			/* Bitmap of pages that differ */
+)
+{
+	BYTE page[SPI_PAGE_SIZE];
+	DWORD address;
+	WORD bit;
+	UINT n;
+	BYTE blank;
+
+	address = spidisk->top_address + sector * SPI_ERASE_SIZE;
+	*diff = 0;
+
+	for(bit=1 ; bit & SPI_PAGE_ALL ; bit <<= 1) {
+		if (spi_read(page, address, SPI_PAGE_SIZE)) return RES_ERROR;
+
+		blank = 1;
+		for(n=0 ; n<SPI_PAGE_SIZE ; n++) {
+			if (page[n] != 0xff) blank = 0;
+			if (page[n] != buff[n]) {
+				if ((page[n] & buff[n]) != buff[n]) return RES_ERROR;
+				*diff |= bit;
+			}
+			if (!_USE_SPI_SKIPERASE && !blank && (*diff & bit)) return RES_ERROR;
 		}
 
-		address += SPI_ERASE_SIZE;
+		buff += SPI_PAGE_SIZE;
+		address += SPI_PAGE_SIZE;
 	}
 
+	return RES_OK;
+}
 
-	lba_sector = 0;
-	rsv_sector = rsv_top_sector;
-	sat_address = startaddr + sat_top_sector * SPI_ERASE_SIZE;
+static DRESULT write_physector(
+	const BYTE *buff,	/* Data to be written */
+	DWORD sector		/* Sector address in Offset */
+)
+{
+	DWORD address;
+	UINT retry;
+	WORD diff;
+#if _USE_SPI_ERASEPOOL
+	int hit;
+#endif
 
-	for(n=0 ; n<SPI_PAGE_SIZE ; n++) buff[n] = 0xff;
+	if (spidisk == NULL) return RES_NOTRDY;
+	address = spidisk->top_address + sector * SPI_ERASE_SIZE;
 
-	do {
-		phy_sector = lba_sector;
+	spidisk->stat.write_count++;
+#if _USE_SPI_ERASEPOOL
+	hit = pool_take(sector);
+#endif
 
-		while(1) {
-			address = startaddr + phy_sector * SPI_ERASE_SIZE;
+	if (compare_physector(buff, sector, &diff) == RES_OK) {
 
-			for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
-				if (spi_erase_sector(address) == RES_OK) break;
+		// eςȂZN^͏܂Ȃ 
+		if (_USE_SPI_WRITEELISION && diff == 0) {
+			spidisk->stat.elide_count++;
+			spidisk->stat.elide_bytes += SPI_SECTOR_SIZE;
+			return RES_OK;
+		}
+
+		// ς݂̃y[Wς鏑݂A0ɂrbg͓̏eςy[WvO 
+		// (v[ŏς݂ɂZN^Ar̓ǂݏoŏς݂ł邱Ƃm߂ĂŃvO) 
+		// vOɎsꍇ͏Ă珑 
+		if (diff != 0) {
+#if SPI_SCRUB_QUEUE > 0
+			scrub_drop(sector, 1);
+#endif
+			if (program_physector(buff, sector, diff) == RES_OK) {
+				spidisk->stat.erase_skip_count++;
+#if _USE_SPI_ERASEPOOL
+				if (hit) spidisk->stat.pool_hit_count++;
+#endif
+				return RES_OK;
 			}
-			if (retry) {
-				break;
-			} else {
-				phy_sector = rsv_sector++;
+		}
+	}
 
-				if (phy_sector >= sat_top_sector) {
-					dgb_printf("\n[!] remap lba %d was failed.\n", lba_sector);
-					return RES_ERROR;
+#if SPI_SCRUB_QUEUE > 0
+	scrub_drop(sector, 1);
+#endif
+#if _USE_SPI_ERASEPOOL
+	spidisk->stat.pool_miss_count++;
+#endif
+	for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+		spidisk->stat.erase_count++;
+		if (spi_erase_sector(address) == RES_OK) break;
+	}
+	if (retry == 0) return RES_ERROR;
+
+	return program_physector(buff, sector, SPI_PAGE_ALL);
+}
+
+#if _USE_SPI_BLOCKERASE
+// ZN^̃ubN(block0=32kB / 1=64kB) 
+static DRESULT erase_physector_block(
+	DWORD sector,		/* Sector address in Offset */
+	UINT block
+)
+{
+#if _USE_SPI_ERASEPOOL
+	UINT i;
+#endif
+
+	if (spidisk == NULL) return RES_NOTRDY;
+
+#if SPI_SCRUB_QUEUE > 0
+	scrub_drop(sector, SPI_BLOCK_SECTORS(block));
+#endif
+#if _USE_SPI_ERASEPOOL
+	for(i=0 ; i<SPI_BLOCK_SECTORS(block) ; i++) pool_take(sector + i);
+#endif
+	return spi_erase_block(spidisk->top_address + sector * SPI_ERASE_SIZE, block);
+}
+#endif
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Log-structured sector allocation                                      */
+/*-----------------------------------------------------------------------*/
+
+#if _USE_SPI_LOG
+// `FbN|Cg̃e[u̐擪AhX(lba0̏ꍇ͕ZN^̏ԃe[uA1̏ꍇLBAϊe[u) 
+static DWORD ftl_ckpaddress(
+	BYTE base,
+	BYTE lba
+)
+{
+	DWORD address;
+
+	address = spidisk->top_address + (spidisk->sat_top_sector + base * spidisk->ckp_count) * SPI_ERASE_SIZE;
+	if (lba) address += ((DWORD)spidisk->data_count * 2 + SPI_PAGE_SIZE - 1) & ~(SPI_PAGE_SIZE - 1);
+
+	return address;
+}
+
+// `FbN|Cg̃e[uǂݏo 
+static DRESULT ftl_loadtable(
+	WORD *table,
+	UINT count,
+	DWORD address
+)
+{
+	BYTE page[SPI_PAGE_SIZE];
+	UINT i,n;
+
+	for(i=0 ; i<count ; i++) {
+		n = (i & (SPI_PAGE_SIZE/2-1)) * 2;
+		if (n == 0) {
+			if (spi_read(page, address, SPI_PAGE_SIZE)) return RES_ERROR;
+			address += SPI_PAGE_SIZE;
+		}
+
+		table[i] = RIFF_GET_WORD(&page[n]);
+	}
+
+	return RES_OK;
+}
+
+// W[iZN^̃wb_ǂݏo(Lȃwb_ȂꍇRES_ERROR) 
+static DRESULT ftl_header(
+	WORD jnl,			/* Journal sector number */
+	WORD *seq,			/* Sequence number */
+	WORD *base			/* Checkpoint to be based on */
+)
+{
+	BYTE rec[SPI_JNL_RECORD_SIZE];
+
+	if (spi_read(rec, spidisk->top_address + (spidisk->jnl_top_sector + jnl) * SPI_ERASE_SIZE, SPI_JNL_RECORD_SIZE)) return RES_ERROR;
+	if (ftl_getrecord(rec, seq, base) || *base > 1) return RES_ERROR;
+
+	return RES_OK;
+}
+
+// ZN^̏񐔂𐔂 
+// 蓖Ă̂т1̂ƂĐ(}EgɃW[i瓯l𕜌ł) 
+static void ftl_wear(
+	WORD sector
+)
+{
+	WORD *w = &spidisk->phy_table[sector];
+
+	if (*w < SPI_FTL_WEARMAX) (*w)++;
+}
+
+// ZN^̏񐔂̕z擾 
+static DRESULT ftl_getwear(
+	DEF_SPIDISKWEAR *wear
+)
+{
+	WORD i, w;
+
+	if (spidisk->mode != SPIDISK_FORMAT_LOG) return RES_PARERR;
+
+	memset(wear, 0, sizeof(DEF_SPIDISKWEAR));
+	wear->sector_count = spidisk->data_count;
+	wear->free_count = spidisk->free_count;
+	wear->min_count = SPI_FTL_WEARMAX;
+
+	for(i=0 ; i<spidisk->data_count ; i++) {
+		w = spidisk->phy_table[i];
+		if (w == SPI_FTL_BAD) {
+			wear->bad_count++;
+			continue;
+		}
+
+		wear->total_count += w;
+		if (w < wear->min_count) {
+			wear->min_count = w;
+			wear->min_sector = i;
+		}
+		if (w >= wear->max_count) {
+			wear->max_count = w;
+			wear->max_sector = i;
+		}
+	}
+
+	return RES_OK;
+}
+
+// O\̃{[}Eg 
+// ŐṼW[iZN^ɂ`FbN|CgǂݏoA`FbN|Cg瑱W[iɓKp 
+static DRESULT ftl_mount(void)
+{
+	BYTE buff[SPI_ERASE_SIZE];
+	const BYTE *p;
+	WORD seq, base, first_seq, a, b, top, first, jnl, used, last;
+	UINT i,n;
+
+	spidisk->lba_table = (WORD *)spiff_malloc(spidisk->lba_count * 2);
+	spidisk->phy_table = (WORD *)spiff_malloc(spidisk->data_count * 2);
+	spidisk->used_map = (BYTE *)spiff_malloc((spidisk->data_count + 7) / 8);
+	if (spidisk->lba_table == NULL || spidisk->phy_table == NULL || spidisk->used_map == NULL) return RES_ERROR;
+
+
+	/* ŐṼW[iZN^T */
+
+	top = spidisk->jnl_count;
+	seq = base = 0;
+
+	for(jnl=0 ; jnl<spidisk->jnl_count ; jnl++) {
+		if (ftl_header(jnl, &a, &b)) continue;
+
+		if (top == spidisk->jnl_count || (WORD)(a - seq) < 0x8000) {
+			top = jnl;
+			seq = a;
+			base = b;
+		}
+	}
+
+	if (top == spidisk->jnl_count) {
+		dgb_printf("    journal is not found.\n");
+		return RES_ERROR;
+	}
+
+	// `FbN|Cg瑱ĂW[iZN^̐擪T 
+	first = top;
+	first_seq = seq;
+
+	for(used=1 ; used<spidisk->jnl_count ; used++) {
+		jnl = (first + spidisk->jnl_count - 1) % spidisk->jnl_count;
+		if (ftl_header(jnl, &a, &b) || b != base || a != (WORD)(first_seq - 1)) break;
+
+		first = jnl;
+		first_seq = a;
+	}
+
+
+	/* `FbN|Cg̓ǂݏoƃW[i̓Kp */
+
+	if (ftl_loadtable(spidisk->phy_table, spidisk->data_count, ftl_ckpaddress(base, 0))) return RES_ERROR;
+	if (ftl_loadtable(spidisk->lba_table, spidisk->lba_count, ftl_ckpaddress(base, 1))) return RES_ERROR;
+
+	spidisk->alloc_sector = 0;
+	last = 0;
+
+	for(jnl=first ; ; jnl=(jnl + 1) % spidisk->jnl_count) {
+		if (read_physector(buff, spidisk->jnl_top_sector + jnl)) return RES_ERROR;
+
+		last = 0;
+		for(i=1 ; i<SPI_JNL_RECORDS ; i++) {
+			p = &buff[i * SPI_JNL_RECORD_SIZE];
+
+			// ݓr̃R[h͓ǂݔ΂A̎ǋL 
+			for(n=0 ; n<SPI_JNL_RECORD_SIZE && p[n] == 0xff ; n++);
+			if (n == SPI_JNL_RECORD_SIZE) continue;
+			last = i;
+
+			if (ftl_getrecord(p, &a, &b)) continue;
+
+			if (a == SPI_FTL_BADMARK) {
+				if (b < spidisk->data_count) spidisk->phy_table[b] = SPI_FTL_BAD;
+
+			} else if (a < spidisk->lba_count && (b < spidisk->data_count || b == SPI_FTL_UNMAPPED)) {
+				spidisk->lba_table[a] = b;
+				if (b != SPI_FTL_UNMAPPED) {
+					ftl_wear(b);
+					spidisk->alloc_sector = b + 1;						// ŌɏZN^̎犄蓖Ă 
 				}
 			}
 		}
 
-		n = (lba_sector & (SPI_PAGE_SIZE/2-1)) * 2;
-		buff[n] = phy_sector & 0xff;
-		buff[n+1] = (phy_sector >> 8) & 0xff;
+		if (jnl == top) break;
+	}
 
-		lba_sector++;
+	spidisk->jnl_sector = top;
+	spidisk->jnl_record = last + 1;
+	spidisk->jnl_seq = seq;
+	spidisk->jnl_used = used;
+	spidisk->ckp_base = base;
 
-		if ( (lba_sector & (SPI_PAGE_SIZE/2-1)) == 0 || lba_sector == dat_sector_count) {
-			for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
-				if (spi_program_page(buff, sat_address) == RES_OK) break;
-			}
-			if (retry == 0) {
-				dgb_printf("\n[!] sector allocation table program was failed. (0x%08x)\n", sat_address);
-				return RES_ERROR;
-			}
 
-			sat_address += SPI_PAGE_SIZE;
+	/* gp̕ZN^ */
 
-			for(n=0 ; n<SPI_PAGE_SIZE ; n++) buff[n] = 0xff;
-			dgb_printf(".");
+	memset(spidisk->used_map, 0, (spidisk->data_count + 7) / 8);
+
+	for(i=0 ; i<spidisk->lba_count ; i++) {
+		b = spidisk->lba_table[i];
+		if (b < spidisk->data_count) SPI_FTL_SETUSED(b);
+	}
+	for(i=0 ; i<spidisk->data_count ; i++) {
+		if (spidisk->phy_table[i] == SPI_FTL_BAD) SPI_FTL_SETUSED(i);
+	}
+
+	spidisk->free_count = 0;
+	for(i=0 ; i<spidisk->data_count ; i++) {
+		if (!SPI_FTL_USED(i)) spidisk->free_count++;
+	}
+	if (spidisk->alloc_sector >= spidisk->data_count) spidisk->alloc_sector = 0;
+
+	dgb_printf("    journal sector %d-%d (seq %d, %d records), checkpoint %d\n    free sector count = %d\n",
+					first, top, seq, last, base, spidisk->free_count);
+
+	return RES_OK;
+}
+
+
+#if _USE_SPI_WRITE
+// LBAϊe[uƕZN^̏ԃe[u`FbN|Cgɏ 
+static DRESULT ftl_checkpoint(
+	BYTE base
+)
+{
+	BYTE buff[SPI_ERASE_SIZE];
+	DWORD offset, lba_offset;
+	WORD sector, v;
+	BYTE policy;
+	UINT i,n;
+	DRESULT res;
+
+	lba_offset = ftl_ckpaddress(0, 1) - ftl_ckpaddress(0, 0);
+	sector = spidisk->sat_top_sector + base * spidisk->ckp_count;
+
+	policy = spidisk->verify.policy;
+	spidisk->verify.policy = SPIDISK_VERIFY_FULL;					// Ǘ͏Ƀxt@C 
+	res = RES_OK;
+
+	for(offset=0,i=0 ; i<spidisk->ckp_count && res == RES_OK ; i++) {
+		for(n=0 ; n<SPI_ERASE_SIZE ; n+=2, offset+=2) {
+			if (offset < (DWORD)spidisk->data_count * 2) {
+				v = spidisk->phy_table[offset / 2];
+			} else if (offset >= lba_offset && offset < lba_offset + (DWORD)spidisk->lba_count * 2) {
+				v = spidisk->lba_table[(offset - lba_offset) / 2];
+			} else {
+				v = 0xffff;
+			}
+
+			RIFF_SET_WORD(&buff[n], v);
 		}
 
-	} while(lba_sector < dat_sector_count);
+		res = write_physector(buff, sector + i);
+	}
 
-	dgb_printf("done\n");
+	spidisk->verify.policy = policy;
+	if (res) return RES_ERROR;
+
+	spidisk->stat.checkpoint_count++;
+
+	return RES_OK;
+}
+
+// ̃W[iZN^Ɉڂ(̃ZN^łÂZN^ɂȂꍇ͂̃`FbN|Cgɏłڂ) 
+// ZN^Lȃ`FbN|Cg瑱W[iɊ܂܂Ȃ悤ɂ邽߁A`FbN|Cg̊ԂɎĝjnl_count-1ZN^܂ 
+static DRESULT ftl_nextjournal(void)
+{
+	BYTE rec[SPI_JNL_RECORD_SIZE];
+	DWORD address;
+	WORD next;
+	BYTE base;
+	UINT retry;
 
+	base = spidisk->ckp_base;
+
+	if (spidisk->jnl_used >= spidisk->jnl_count - 1) {
+		base ^= 1;
+		if (ftl_checkpoint(base)) return RES_ERROR;
+	}
+
+	next = (spidisk->jnl_sector + 1) % spidisk->jnl_count;
+	address = spidisk->top_address + (spidisk->jnl_top_sector + next) * SPI_ERASE_SIZE;
+
+	// wb_ɑR[hƓ8oCgvO 
+	ftl_setrecord(rec, spidisk->jnl_seq + 1, base);
+
+	for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+		if (spi_erase_sector(address) == RES_OK && spi_program_bytes(rec, address, SPI_JNL_RECORD_SIZE, 1) == RES_OK) break;
+	}
+	if (retry == 0) return RES_ERROR;
+
+	spidisk->jnl_sector = next;
+	spidisk->jnl_record = 1;
+	spidisk->jnl_seq++;
+
+	if (base != spidisk->ckp_base) {
+		spidisk->ckp_base = base;
+		spidisk->jnl_used = 1;
+	} else {
+		spidisk->jnl_used++;
+	}
+
+	return RES_OK;
+}
+
+// W[iɃR[hǋL(vOɎsꍇ͎̃R[hɏ) 
+static DRESULT ftl_journal(
+	WORD a,
+	WORD b
+)
+{
+	DWORD address;
+	UINT retry;
+	DRESULT res;
+
+	for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+		if (spidisk->jnl_record >= SPI_JNL_RECORDS && ftl_nextjournal()) return RES_ERROR;
+
+		address = spidisk->top_address + (spidisk->jnl_top_sector + spidisk->jnl_sector) * SPI_ERASE_SIZE
+					+ spidisk->jnl_record * SPI_JNL_RECORD_SIZE;
+
+		res = jnl_program(address, a, b);
+		spidisk->jnl_record++;
+
+		if (res == RES_OK) {
+			spidisk->stat.journal_count++;
+			return RES_OK;
+		}
+	}
+
+	return RES_ERROR;
+}
+
+// ZN^sǃZN^ɂ 
+static DRESULT ftl_setbad(
+	WORD sector
+)
+{
+	dgb_printf("[FTL] bad sector %d\n", sector);
 
-	/* fBXNe[u쐬 */
+	spidisk->phy_table[sector] = SPI_FTL_BAD;
+	if (!SPI_FTL_USED(sector)) {
+		SPI_FTL_SETUSED(sector);
+		spidisk->free_count--;
+	}
 
-	for(n=0 ; n<SPI_PAGE_SIZE ; n++) buff[n] = 0xff;
+	return ftl_journal(SPI_FTL_BADMARK, sector);
+}
 
-	RIFF_SET_ID(&buff[0], 'R','I','F','F');
-	RIFF_SET_DWORD(&buff[4], 4+8+16);
-	RIFF_SET_ID(&buff[8], 'D','I','S','K');
+// gȂȂZN^󂫃ZN^ɖ߂(v[gꍇ͏҂ɉ) 
+static void ftl_release(
+	WORD sector
+)
+{
+	SPI_FTL_CLRUSED(sector);
+	spidisk->free_count++;
 
-	RIFF_SET_ID(&buff[12], 'i','n','f','o');
-	RIFF_SET_DWORD(&buff[16], 16);
+#if SPI_SCRUB_QUEUE > 0
+	scrub_drop(sector, 1);
+#endif
+#if _USE_SPI_ERASEPOOL
+	pool_discard(sector);
+#endif
+}
 
-	RIFF_SET_DWORD(&buff[20], 1);									// + 0 DW VERSION
-	RIFF_SET_DWORD(&buff[24], all_sector_count * SPI_ERASE_SIZE);	// + 4 DW DISKSIZE
-	RIFF_SET_DWORD(&buff[28], startaddr);							// + 8 DW DISK_TOPADDR
-	RIFF_SET_WORD(&buff[32], rsv_top_sector);						// +12 W  RSV_TOP_SECTOR
-	RIFF_SET_WORD(&buff[34], sat_top_sector);						// +14 W  SAT_TOP_SECTOR
+// 󂫃ZN^ς݂ɂ(v[ŏς݂łȂ΃uN`FbNď) 
+static DRESULT ftl_erase(
+	WORD sector
+)
+{
+	DWORD address;
+	UINT retry;
 
-	address = diskinfo_sector * SPI_ERASE_SIZE;
+#if _USE_SPI_ERASEPOOL
+	if (pool_take(sector)) return RES_OK;
+#endif
+	spi_erase_finish();
+	if (blank_physector(sector) == RES_OK) return RES_OK;
 
+#if SPI_SCRUB_QUEUE > 0
+	scrub_drop(sector, 1);
+#endif
+	address = spidisk->top_address + sector * SPI_ERASE_SIZE;
 	for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+		spidisk->stat.erase_count++;
 		if (spi_erase_sector(address) == RES_OK) break;
 	}
-	if (retry == 0) {
-		dgb_printf("[!] diskinfo sector erase was failed. (0x%08x)\n", address);
-		return RES_ERROR;
-	}
-
-	for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
-		if (spi_program_page(buff, address) == RES_OK) break;
-	}
-	if (retry == 0) {
-		dgb_printf("[!] diskinfo sector program was failed. (0x%08x)\n", address);
-		return RES_ERROR;
-	}
+	if (retry == 0) return RES_ERROR;
 
+	spidisk->stat.pool_miss_count++;
 
 	return RES_OK;
 }
-#endif
-
-
-
-/*-----------------------------------------------------------------------*/
-/* Initialize a physical disk                                            */
-/*-----------------------------------------------------------------------*/
-
-DEF_SPIDISK spidiskinfo;
 
-static DRESULT spidisk_init(void)
+// ݐ̋󂫃ZN^蓖Ăďς݂ɂ 
+// J[\󂫃ZN^SPI_WEAR_WINDOWׂď񐔂ŏ̂̂I 
+static DRESULT ftl_alloc(
+	WORD *sector
+)
 {
-	DWORD memsize, id, infosector;
-	DWORD disksize, startaddr, version;
-	WORD rsv_top_sector, sat_top_sector;
-	WORD all_sector_count, rsv_sector_count, sat_sector_count, dat_sector_count;
-	BYTE buff[SPI_ERASE_SIZE];
-	UINT i;
+	WORD s, cand;
+	UINT n,found;
+
+	for(;;) {
+		cand = spidisk->data_count;
+		for(n=spidisk->data_count,found=0 ; n>0 && found<SPI_FTL_WINDOW ; n--) {
+			s = spidisk->alloc_sector;
+			if (++spidisk->alloc_sector >= spidisk->data_count) spidisk->alloc_sector = 0;
+			if (SPI_FTL_USED(s)) continue;
+
+			if (cand == spidisk->data_count || spidisk->phy_table[s] < spidisk->phy_table[cand]) cand = s;
+			found++;
+		}
 
-	/* fBXNe[uǂݏo */
+		if (cand == spidisk->data_count) {
+			dgb_printf("[!] no free sector.\n");
+			return RES_ERROR;
+		}
 
-	if (spi_getinfo(&memsize, &id)) return RES_NOTRDY;
+		spidisk->alloc_sector = (cand + 1 < spidisk->data_count) ? cand + 1 : 0;
 
-	infosector = (memsize / SPI_ERASE_SIZE) - 1;
-	spi_read(buff, infosector * SPI_ERASE_SIZE, SPI_ERASE_SIZE);
+#if _USE_SPI_ERASEPOOL
+		// 񐔂̍SPI_WEAR_SLACKȓł΃v[ŏς݂̃ZN^D悷 
+		for(n=spidisk->pool_clean_count ; n>0 ; n--) {
+			s = spidisk->pool_clean[n-1];
+			if (s >= spidisk->data_count || SPI_FTL_USED(s)) continue;
 
-	dgb_printf("[INFO] diskinfo offset = 0x%08x (sector %d)\n",
-					infosector * SPI_ERASE_SIZE, infosector);
+			if (SPI_WEAR_WINDOW == 0 || spidisk->phy_table[s] <= spidisk->phy_table[cand] + SPI_WEAR_SLACK) {
+				pool_take(s);
+				spidisk->stat.pool_hit_count++;
+				*sector = s;
+				return RES_OK;
+			}
+		}
+#endif
 
-	if ( !(RIFF_CHECK_ID(&buff[8], 'D','I','S','K') && RIFF_CHECK_ID(&buff[12], 'i','n','f','o')) ) {
-		dgb_printf("    disk infomation data is not found.\n");
-		return RES_NOTRDY;
-	}
+		if (ftl_erase(cand) == RES_OK) {
+			*sector = cand;
+			return RES_OK;
+		}
 
-	version = RIFF_GET_DWORD(&buff[20]);			// + 0 DW VERSION
-	disksize  = RIFF_GET_DWORD(&buff[24]);			// + 4 DW DISKSIZE
-	startaddr = RIFF_GET_DWORD(&buff[28]);			// + 8 DW DISK_TOPADDR
-	rsv_top_sector = RIFF_GET_WORD(&buff[32]);		// +12  W RSV_TOP_SECTOR
-	sat_top_sector = RIFF_GET_WORD(&buff[34]);		// +14  W SAT_TOP_SECTOR
+		if (ftl_setbad(cand)) return RES_ERROR;
+	}
+}
 
-	dgb_printf("    signature :");
-	for(i=0 ; i<8 ; i++) dgb_printf(" '%c'", buff[8+i]);
-	dgb_printf("\n    version : %d\n", version);
+// LBAZN^󂫃ZN^ɏŃW[iɋL^ 
+// ɏꍇ(ǋLEFAT̊蓖ĂȂ)͍̕ZN^ɏ 
+// 󂫃ZN^ɏł犄蓖Ăς(ݒɓd؂ĂÂf[^c) 
+// ̕ZN^̉͌Ăяoōs 
+static DRESULT ftl_program(
+	const BYTE *buff,	/* Data to be written */
+	DWORD lba_sector	/* Sector address in LBA */
+)
+{
+	WORD sector;
+	UINT retry;
 
+	for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+		if (ftl_alloc(&sector)) return RES_ERROR;
+		if (program_physector(buff, sector, SPI_PAGE_ALL) == RES_OK) break;
+		if (ftl_setbad(sector)) return RES_ERROR;
+	}
+	if (retry == 0) return RES_ERROR;
 
-	/* eBXN\̂̏ */
+	if (ftl_journal(lba_sector, sector)) return RES_ERROR;
 
-	all_sector_count = disksize / SPI_ERASE_SIZE;
-	rsv_sector_count = sat_top_sector - rsv_top_sector;
-	sat_sector_count = ((all_sector_count - rsv_sector_count)*2 / SPI_ERASE_SIZE) + 1;
-	dat_sector_count = all_sector_count - rsv_sector_count - sat_sector_count;
+	ftl_wear(sector);
+	spidisk->stat.ftl_write_count++;
+	spidisk->lba_table[lba_sector] = sector;
+	SPI_FTL_SETUSED(sector);
+	spidisk->free_count--;
 
-	spidisk = &spidiskinfo;
+	return RES_OK;
+}
 
-	spidisk->storage_size = disksize;
-	spidisk->top_address = startaddr;
-	spidisk->rsv_top_sector = rsv_top_sector;
-	spidisk->sat_top_sector = sat_top_sector;
+static DRESULT ftl_write(
+	const BYTE *buff,	/* Data to be written */
+	DWORD lba_sector	/* Sector address in LBA */
+)
+{
+	WORD old;
+#if _USE_SPI_WRITEELISION
+	WORD diff;
+#endif
 
-	spidisk->pba_count = all_sector_count;
-	spidisk->rsv_count = rsv_sector_count;
-	spidisk->lba_count = dat_sector_count;
+	old = spidisk->lba_table[lba_sector];
+	spidisk->stat.write_count++;
 
-	spidisk->lba_table = NULL;
-	spidisk->last_rsv_sector = 0;
+	// 蓖Ē̃ZN^ɂ͏㏑Ȃ(ȗłꍇ󂫃ZN^ɏ) 
+	// ݒɓd؂ĂÂf[^c悤ɁA_USE_SPI_SKIPERASE̓O\ł͎gȂ 
+#if _USE_SPI_WRITEELISION
+	if (old != SPI_FTL_UNMAPPED && compare_physector(buff, old, &diff) == RES_OK && diff == 0) {
+		spidisk->stat.elide_count++;
+		spidisk->stat.elide_bytes += SPI_SECTOR_SIZE;
+		return RES_OK;
+	}
+#endif
 
-	dgb_printf("    diskimage top offset = 0x%08x (sector %d)\n    reserve sector top = %d\n    sat sector top = %d\n",
-					startaddr, startaddr / SPI_ERASE_SIZE,
-					spidisk->rsv_top_sector, spidisk->sat_top_sector);
+	if (ftl_program(buff, lba_sector)) return RES_ERROR;
 
-	dgb_printf("    physical sector count = %d\n    reserve sector count = %d\n    logical sector count = %d\n    sat sector count = %d\n",
-					spidisk->pba_count, spidisk->rsv_count, spidisk->lba_count,
-					sat_sector_count);
+	if (old != SPI_FTL_UNMAPPED) ftl_release(old);
 
 	return RES_OK;
 }
 
-
-
-/*-----------------------------------------------------------------------*/
-/* Access a physical sector                                              */
-/*-----------------------------------------------------------------------*/
-
-static DRESULT read_physector(
-	BYTE *buff,			/* Data buffer to store read data */
-	DWORD sector		/* Sector address in Physical */
+// gȂȂLBAZN^̊蓖ĂO 
+static DRESULT ftl_trim(
+	DWORD start,		/* Start sector in LBA */
+	DWORD end			/* End sector in LBA (inclusive) */
 )
 {
-	DWORD address;
+	DWORD lba;
+	WORD old;
 
-	if (spidisk == NULL) return RES_NOTRDY;
-	address = spidisk->top_address + sector * SPI_ERASE_SIZE;
+	for(lba=start ; lba<=end ; lba++) {
+		old = spidisk->lba_table[lba];
+		if (old == SPI_FTL_UNMAPPED) continue;
 
-	return spi_read(buff, address, SPI_ERASE_SIZE);
-}
+		if (ftl_journal(lba, SPI_FTL_UNMAPPED)) return RES_ERROR;
+
+		spidisk->lba_table[lba] = SPI_FTL_UNMAPPED;
+		ftl_release(old);
+	}
 
+	return RES_OK;
+}
 
-#if _USE_SPI_WRITE
-static DRESULT write_physector(
-	const BYTE *buff,	/* Data to be written */
-	DWORD sector		/* Sector address in Offset */
-)
+#if _USE_SPI_WEARMOVE
+// ÓIEFAxO : 񐔂ŏ̊蓖čς݃ZN^̃f[^񐔂ő̋󂫃ZN^Ɉڂ 
+// Ȃf[^(t@[EFAC[WȂ)̃ZN^󂫃ZN^ɖ߂ďɎg 
+// 񐔂̍SPI_WEAR_THRESHOLD̏ꍇ0Aڂꍇ1AG[̏ꍇ-1Ԃ 
+static int ftl_migrate(void)
 {
-	DWORD address;
-	UINT i,retry;
+	BYTE buff[SPI_ERASE_SIZE];
+	DWORD lba, cold_lba;
+	WORD s, cold, hot;
 
-	if (spidisk == NULL) return RES_NOTRDY;
-	address = spidisk->top_address + sector * SPI_ERASE_SIZE;
+	cold = hot = spidisk->data_count;
+	cold_lba = 0;
 
-	for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
-		if (spi_erase_sector(address) == RES_OK) break;
-	}
-	if (retry == 0) return RES_ERROR;
+	for(lba=0 ; lba<spidisk->lba_count ; lba++) {
+		s = spidisk->lba_table[lba];
+		if (s == SPI_FTL_UNMAPPED) continue;
 
-	for(i=SPI_ERASEPAGE_COUNT ; i>0 ; i--) {
-		for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
-			if (spi_program_page(buff, address) == RES_OK) break;
+		if (cold == spidisk->data_count || spidisk->phy_table[s] < spidisk->phy_table[cold]) {
+			cold = s;
+			cold_lba = lba;
 		}
-		if (retry == 0) return RES_ERROR;
+	}
+	for(s=0 ; s<spidisk->data_count ; s++) {
+		if (SPI_FTL_USED(s)) continue;
+		if (hot == spidisk->data_count || spidisk->phy_table[s] > spidisk->phy_table[hot]) hot = s;
+	}
 
-		buff += SPI_PAGE_SIZE;
-		address += SPI_PAGE_SIZE;
+	if (cold == spidisk->data_count || hot == spidisk->data_count) return 0;
+	if (spidisk->phy_table[hot] < spidisk->phy_table[cold] + SPI_WEAR_THRESHOLD) return 0;
+
+	if (read_physector(buff, cold)) return -1;
+
+	if (ftl_erase(hot) != RES_OK || program_physector(buff, hot, SPI_PAGE_ALL) != RES_OK) {
+		return ftl_setbad(hot) ? -1 : 0;
 	}
 
-	return RES_OK;
+	if (ftl_journal(cold_lba, hot)) return -1;
+
+	ftl_wear(hot);
+	spidisk->stat.wear_move_count++;
+	spidisk->lba_table[cold_lba] = hot;
+	SPI_FTL_SETUSED(hot);
+	spidisk->free_count--;
+
+	ftl_release(cold);
+
+	return 1;
 }
 #endif
+#endif
+#endif
 
 
 
@@ -725,8 +2974,11 @@ static DRESULT lba_satload(void)
 
 	if (spidisk == NULL) return RES_NOTRDY;
 
+	// SATZN^PʂœǂݏôŁAlba_remap߂ZN^̖܂Ŋmۂ 
+	n = (spidisk->lba_count / (SPI_ERASE_SIZE/2)) + 1;
+
 	if (spidisk->lba_table == NULL) {
-		pcache = (WORD *)spiff_malloc(spidisk->lba_count * 2);
+		pcache = (WORD *)spiff_malloc(n * SPI_ERASE_SIZE);
 
 		if (pcache == NULL) goto error_exit;
 	} else {
@@ -735,7 +2987,7 @@ static DRESULT lba_satload(void)
 
 	p = pcache;
 	sector = spidisk->sat_top_sector;
-	for(n=(spidisk->lba_count / (SPI_ERASE_SIZE/2))+1 ; n>0 ; n--) {
+	for( ; n>0 ; n--) {
 		if (read_physector(buff, sector++)) goto error_exit;
 
 		for(i=0 ; i<SPI_ERASE_SIZE ; i+=2) *p++ = buff[i] | (buff[i+1] << 8);
@@ -748,36 +3000,248 @@ static DRESULT lba_satload(void)
 error_exit:
 	spiff_free(pcache);
 
-	return RES_ERROR;
+	return RES_ERROR;
+}
+#endif
+
+#if _USE_SPI_SATJNL
+// փZN^̃W[i{[LBAϊe[u 
+// e[u̓tH[}bg̔zu(LBA=ZN^)ɃW[iĐč̂ŁASAT̏rœd؂ĂeȂ 
+// SAT̓eƈႤZN^͏ݍݑ҂ɂ 
+static DRESULT sat_mount(void)
+{
+	BYTE buff[SPI_ERASE_SIZE];
+	const BYTE *p;
+	WORD *table, a, b, rsv;
+	UINT i,n,count,jnl;
+
+	count = (spidisk->lba_count / (SPI_ERASE_SIZE/2)) + 1;
+
+	if (spidisk->lba_table == NULL) {
+		spidisk->lba_table = (WORD *)spiff_malloc(count * SPI_ERASE_SIZE);
+		if (spidisk->lba_table == NULL) return RES_ERROR;
+	}
+	table = spidisk->lba_table;
+
+	for(i=0 ; i<count * (SPI_ERASE_SIZE/2) ; i++) table[i] = (i < spidisk->lba_count)? i : 0xffff;
+
+
+	/* W[i̍Đ */
+
+	rsv = spidisk->rsv_top_sector - 1;
+	spidisk->jnl_sector = 0;
+	spidisk->jnl_record = 0;
+
+	for(jnl=0 ; jnl<spidisk->jnl_count ; jnl++) {
+		if (read_physector(buff, spidisk->jnl_top_sector + jnl)) return RES_ERROR;
+
+		for(i=0 ; i<SPI_JNL_RECORDS ; i++) {
+			p = &buff[i * SPI_JNL_RECORD_SIZE];
+
+			// ݓr̃R[h͓ǂݔ΂A̎ǋL 
+			for(n=0 ; n<SPI_JNL_RECORD_SIZE && p[n] == 0xff ; n++);
+			if (n == SPI_JNL_RECORD_SIZE) continue;
+			spidisk->jnl_sector = jnl;
+			spidisk->jnl_record = i + 1;
+
+			if (ftl_getrecord(p, &a, &b)) continue;
+
+			if (a < spidisk->lba_count && b >= spidisk->rsv_top_sector && b < spidisk->sat_top_sector) {
+				table[a] = b;
+				if (b > rsv) rsv = b;
+			}
+		}
+	}
+
+	spidisk->last_rsv_sector = rsv;
+
+
+	/* SATƔr */
+
+	memset(spidisk->sat_dirty, 0, sizeof(spidisk->sat_dirty));
+
+	for(i=0 ; i<count ; i++) {
+		if (read_physector(buff, spidisk->sat_top_sector + i)) return RES_ERROR;
+
+		for(n=0 ; n<SPI_ERASE_SIZE/2 ; n++) {
+			if ((buff[n*2] | (buff[n*2+1] << 8)) != table[i * (SPI_ERASE_SIZE/2) + n]) break;
+		}
+		if (n < SPI_ERASE_SIZE/2) spidisk->sat_dirty[i / 8] |= 1 << (i & 7);
+	}
+
+	dgb_printf("    journal sector %d (%d records), last reserve sector = %d\n",
+					spidisk->jnl_sector, spidisk->jnl_record, rsv);
+
+	return RES_OK;
+}
+
+#if _USE_SPI_WRITE
+// փZN^̊蓖ĂW[iɒǋL 
+// W[i͑փZN^̐~Ďs񐔂̃R[h悤ɃtH[}bgĂ̂ŁAĎg񂷂Ƃ͂Ȃ 
+static DRESULT sat_journal(
+	WORD lba,
+	WORD rsv
+)
+{
+	DWORD address;
+	UINT retry;
+	DRESULT res;
+
+	for(retry=SPI_RETRY_COUNT ; retry>0 ; retry--) {
+		if (spidisk->jnl_record >= SPI_JNL_RECORDS) {
+			if (spidisk->jnl_sector + 1 >= spidisk->jnl_count) return RES_ERROR;
+
+			spidisk->jnl_sector++;
+			spidisk->jnl_record = 0;
+		}
+
+		address = spidisk->top_address + (spidisk->jnl_top_sector + spidisk->jnl_sector) * SPI_ERASE_SIZE
+					+ spidisk->jnl_record * SPI_JNL_RECORD_SIZE;
+
+		res = jnl_program(address, lba, rsv);
+		spidisk->jnl_record++;
+
+		if (res == RES_OK) {
+			spidisk->stat.journal_count++;
+			return RES_OK;
+		}
+	}
+
+	return RES_ERROR;
+}
+
+// W[i̓eSATɏݍ(limit͏SATZN^̏ŁA0͐Ȃ) 
+// ZN^Ԃ(G[̏ꍇ-1) 
+static int sat_fold(
+	DWORD limit
+)
+{
+	BYTE buff[SPI_ERASE_SIZE];
+	WORD *p;
+	BYTE policy;
+	UINT i,n,count;
+	int done;
+
+	count = (spidisk->lba_count / (SPI_ERASE_SIZE/2)) + 1;
+
+	policy = spidisk->verify.policy;
+	spidisk->verify.policy = SPIDISK_VERIFY_FULL;					// Ǘ͏Ƀxt@C 
+	done = 0;
+
+	for(i=0 ; i<count && (limit == 0 || (DWORD)done < limit) ; i++) {
+		if ((spidisk->sat_dirty[i / 8] & (1 << (i & 7))) == 0) continue;
+
+		p = spidisk->lba_table + i * (SPI_ERASE_SIZE/2);
+		for(n=0 ; n<SPI_ERASE_SIZE ; n+=2,p++) {
+			buff[n] = *p & 0xff;
+			buff[n+1] = (*p >> 8) & 0xff;
+		}
+
+		if (write_physector(buff, spidisk->sat_top_sector + i)) {
+			done = -1;
+			break;
+		}
+
+		spidisk->sat_dirty[i / 8] &= ~(1 << (i & 7));
+		spidisk->stat.sat_fold_count++;
+		done++;
+	}
+
+	spidisk->verify.policy = policy;
+
+	return done;
+}
+#endif
+#endif
+
+
+static DRESULT lba_getnumber(
+	DWORD lba_sector,	/* Sector address in LBA */
+	DWORD *phy_sector	/* Sector address in Physical */
+)
+{
+	DWORD address;
+	BYTE buff[2];
+
+	if (spidisk == NULL) return RES_NOTRDY;
+	if (lba_sector >= spidisk->lba_count) return RES_PARERR;
+
+	if (_USE_SPI_SATCACHE && spidisk->lba_table != NULL) {
+		*phy_sector = *(spidisk->lba_table + lba_sector);
+
+	} else {
+		address = spidisk->top_address + spidisk->sat_top_sector * SPI_ERASE_SIZE + lba_sector * 2;
+		spi_read(buff, address, 2);
+
+		*phy_sector = buff[0] | (buff[1] << 8);
+	}
+
+	return RES_OK;
 }
-#endif
-
 
-static DRESULT lba_getnumber(
-	DWORD lba_sector,	/* Sector address in LBA */
-	DWORD *phy_sector	/* Sector address in Physical */
+// lba_sectorAnum(SPI_READ_RUNȉ)̕ZN^ԍ擾 
+static DRESULT lba_getrun(
+	DWORD lba_sector,	/* Start sector address in LBA */
+	UINT num,			/* Number of sectors (1`SPI_READ_RUN) */
+	DWORD *phy_sector	/* Sector address array in Physical */
 )
 {
 	DWORD address;
-	BYTE buff[2];
+	BYTE buff[SPI_READ_RUN * 2];
+	UINT i;
 
 	if (spidisk == NULL) return RES_NOTRDY;
-	if (lba_sector >= spidisk->lba_count) return RES_PARERR;
+	if (num == 0 || num > SPI_READ_RUN) return RES_PARERR;
+	if (lba_sector >= spidisk->lba_count || num > spidisk->lba_count - lba_sector) return RES_PARERR;
 
 	if (_USE_SPI_SATCACHE && spidisk->lba_table != NULL) {
-		*phy_sector = *(spidisk->lba_table + lba_sector);
+		for(i=0 ; i<num ; i++) phy_sector[i] = *(spidisk->lba_table + lba_sector + i);
 
 	} else {
+		// SAT̘AGg1œǂݏo 
 		address = spidisk->top_address + spidisk->sat_top_sector * SPI_ERASE_SIZE + lba_sector * 2;
-		spi_read(buff, address, 2);
+		if (spi_read(buff, address, num * 2)) return RES_ERROR;
 
-		*phy_sector = buff[0] | (buff[1] << 8);
+		for(i=0 ; i<num ; i++) phy_sector[i] = buff[i*2] | (buff[i*2+1] << 8);
 	}
 
 	return RES_OK;
 }
 
 
+#if _USE_SPI_WRITE && _USE_SPI_BLOCKERASE
+// LBAZN^n܂鏑݂ubNł邩ׂ 
+// ZN^ubNEn܂AubN̕ZN^ׂĘALBAɊ蓖ĂĂꍇ 
+// ubN̎(0=32kB / 1=64kB)Ԃ(łȂꍇ-1) 
+static int lba_blockrun(
+	DWORD lba_sector,	/* Sector address in LBA */
+	DWORD phy_sector,	/* Sector address in Physical */
+	UINT count			/* Number of sectors to write */
+)
+{
+	DWORD address, sector;
+	UINT i;
+	int block;
+
+	address = spidisk->top_address + phy_sector * SPI_ERASE_SIZE;
+
+	for(block=1 ; block>=0 ; block--) {
+		if (spidiskinfo.block_cmd[block] == 0) continue;
+		if (count < SPI_BLOCK_SECTORS(block)) continue;
+		if (address & (SPI_BLOCK_SECTORS(block) * SPI_ERASE_SIZE - 1)) continue;
+
+		for(i=1 ; i<SPI_BLOCK_SECTORS(block) ; i++) {
+			if (lba_getnumber(lba_sector + i, &sector)) return -1;
+			if (sector != phy_sector + i) break;					// փZN^Ɋ蓖ĂĂ 
+		}
+		if (i == SPI_BLOCK_SECTORS(block)) return block;
+	}
+
+	return -1;
+}
+#endif
+
+
 #if _USE_SPI_WRITE
 static DRESULT lba_remap(
 	DWORD lba_sector	/* Sector address in LBA */
@@ -830,6 +3294,24 @@ static DRESULT lba_remap(
 	// 蓖ĂփZN^Ȃ 
 	if (rsv >= spidisk->sat_top_sector) return RES_ERROR;
 
+#if _USE_SPI_SATJNL
+	// W[i{[̓R[h1ǋL邾ŁASATւ̏߂SPIDISK_CTRL_IDLEōs 
+	if (spidisk->jnl_count) {
+		if (sat_journal(lba_sector, rsv)) return RES_ERROR;
+
+		spidisk->last_rsv_sector = rsv;
+		*(spidisk->lba_table + lba_sector) = rsv;
+		satsector = lba_sector / (SPI_ERASE_SIZE/2);
+		spidisk->sat_dirty[satsector / 8] |= 1 << (satsector & 7);
+
+		return RES_OK;
+	}
+#endif
+
+	// փZN^Ɏgp}bvɋL^(SAT̏ݒɓd؂ĂZN^dɊ蓖ĂȂ) 
+	if (rsvmap_program(spidisk->info_address, rsv - spidisk->rsv_top_sector + 1)) return RES_ERROR;
+	spidisk->last_rsv_sector = rsv;
+
 	// փZN^̊蓖 
 	satsector = spidisk->sat_top_sector + (lba_sector / (SPI_ERASE_SIZE/2));
 
@@ -858,11 +3340,286 @@ static DRESULT lba_remap(
 		if (res) return RES_ERROR;
 	} while(res);
 
-	spidisk->last_rsv_sector = rsv;
 
+	return RES_OK;
+}
+
+// gȂȂLBAZN^̕ZN^ 
+// v[gꍇ͏҂ɉSPIDISK_CTRL_IDLEŏ(gȂꍇ͍Ō̏͊҂ɖ߂) 
+static DRESULT lba_trim(
+	DWORD start,		/* Start sector in LBA */
+	DWORD end			/* End sector in LBA (inclusive) */
+)
+{
+	DWORD lba, offset;
+
+	if (spidisk == NULL) return RES_NOTRDY;
+	if (start > end || end >= spidisk->lba_count) return RES_PARERR;
+
+#if _USE_SPI_LOG
+	if (spidisk->mode == SPIDISK_FORMAT_LOG) return ftl_trim(start, end);
+#endif
+
+	for(lba=start ; lba<=end ; lba++) {
+		if (lba_getnumber(lba, &offset)) return RES_ERROR;
+
+#if _USE_SPI_ERASEPOOL
+		pool_discard(offset);
+#else
+		// ς݂̃ZN^͏Ȃ 
+		spi_erase_finish();
+		if (blank_physector(offset) == RES_OK) continue;
+
+ #if SPI_SCRUB_QUEUE > 0
+		scrub_drop(offset, 1);
+ #endif
+		spi_erase_sector_start(spidisk->top_address + offset * SPI_ERASE_SIZE);
+		spidisk->stat.trim_erase_count++;
+#endif
+	}
+
+	return RES_OK;
+}
+
+// LBAZN^tbVɏ 
+static DRESULT lba_write(
+	const BYTE *buff,	/* Data to be written */
+	DWORD sector,		/* Sector address in LBA */
+	UINT count			/* Number of sectors to write */
+)
+{
+	DWORD offset;
+#if _USE_SPI_BLOCKERASE
+	UINT n;
+	int block;
+	WORD diff;
+#endif
+
+	if (spidisk == NULL) return RES_NOTRDY;
+
+	while(count) {
+#if _USE_SPI_LOG
+		if (spidisk->mode == SPIDISK_FORMAT_LOG) {
+			if (sector >= spidisk->lba_count || ftl_write(buff, sector)) break;
+
+			buff += SPI_SECTOR_SIZE;
+			sector++;
+			count--;
+			continue;
+		}
+#endif
+		if (lba_getnumber(sector, &offset)) break;
+
+#if _USE_SPI_BLOCKERASE
+		// ubNPʂŘAZN^̓ubNĂvO 
+		// vOɎsZN^͒ʏ̃ZN^݂ōĎs 
+		block = lba_blockrun(sector, offset, count);
+		// ubN̑SZN^Ȃŏ(ς݂Ȃ)ꍇ̓ZN^Pʂ݂̏ɂ 
+		if (block >= 0) {
+			for(n=0 ; n<SPI_BLOCK_SECTORS(block) ; n++) {
+				if (compare_physector(buff + n * SPI_SECTOR_SIZE, offset + n, &diff)) break;
+			}
+			if (n == SPI_BLOCK_SECTORS(block)) block = -1;
+		}
+		if (block >= 0 && erase_physector_block(offset, block) == RES_OK) {
+			spidisk->stat.block_erase_count++;
+			for(n=SPI_BLOCK_SECTORS(block) ; n>0 ; n--) {
+				spidisk->stat.write_count++;
+				if (program_physector(buff, offset, SPI_PAGE_ALL)) break;
+
+				buff += SPI_SECTOR_SIZE;
+				sector++;
+				offset++;
+				count--;
+			}
+			continue;
+		}
+#endif
+
+		if (write_physector(buff, offset)) {
+			if (lba_remap(sector)) break;
+			continue;
+		}
+
+		buff += SPI_SECTOR_SIZE;
+		sector++;
+		count--;
+	}
+
+	return count ? RES_ERROR : RES_OK;
+}
+
+#if SPI_SCRUB_QUEUE > 0
+// ZN^蓖ĂĂLBAZN^T 
+static DRESULT lba_owner(
+	DWORD phy_sector,	/* Sector address in Physical */
+	DWORD *lba_sector	/* Sector address in LBA */
+)
+{
+	DWORD lba, offset;
+
+	// Œ芄蓖Ăł͓ԍLBA璲ׂ 
+	if (phy_sector < spidisk->lba_count && lba_getnumber(phy_sector, &offset) == RES_OK && offset == phy_sector) {
+		*lba_sector = phy_sector;
+		return RES_OK;
+	}
+
+	for(lba=0 ; lba<spidisk->lba_count ; lba++) {
+		if (lba_getnumber(lba, &offset)) return RES_ERROR;
+		if (offset == phy_sector) {
+			*lba_sector = lba;
+			return RES_OK;
+		}
+	}
+
+	return RES_ERROR;
+}
+
+// XNuŃG[ɂȂZN^̃f[^ʂ̃ZN^Ɉڂđւ 
+// ǂݏoê܂܈ڂ̂ŁA蓖Ē̃ZN^ꍇRES_ERRORԂĒʒm 
+// ς݂̃ZN^͈ڂf[^Ȃ̂Ŏ菜ɂ 
+// ڂȂZN^͎CTRL_SYNCōĎs 
+static DRESULT scrub_repair(void)
+{
+	BYTE buff[SPI_ERASE_SIZE];
+	DWORD sector, lba;
+	UINT i,n;
+	DRESULT res, move;
+
+	res = RES_OK;
+
+	for(i=n=0 ; i<spidisk->scrub_failed_count ; i++) {
+		sector = spidisk->scrub_failed[i];
+		if (lba_owner(sector, &lba)) continue;
+
+		dgb_printf("[!] scrub error sector %d (lba %d)\n", sector, lba);
+		res = RES_ERROR;
+
+		move = read_physector(buff, sector);
+#if _USE_SPI_LOG
+		if (spidisk->mode == SPIDISK_FORMAT_LOG) {
+			if (move == RES_OK) move = ftl_program(buff, lba);
+			if (move == RES_OK) ftl_setbad(sector);
+		} else
+#endif
+		{
+			if (move == RES_OK) move = lba_remap(lba);
+			if (move == RES_OK) move = lba_write(buff, lba, 1);
+		}
+
+		if (move != RES_OK) spidisk->scrub_failed[n++] = sector;
+	}
+	spidisk->scrub_failed_count = n;
+
+	return res;
+}
+#endif
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Write-back sector cache                                               */
+/*-----------------------------------------------------------------------*/
+
+#if _USE_SPI_WBCACHE
+// LbVĂLBAZN^T(Ȃꍇ-1) 
+static int wbcache_find(
+	DWORD sector		/* Sector address in LBA */
+)
+{
+	int i;
+
+	for(i=0 ; i<SPI_WBCACHE_COUNT ; i++) {
+		if (spidisk->wb_lba[i] == sector) return i;
+	}
+
+	return -1;
+}
+
+// LbṼGgtbVɏ߂ċ󂯂 
+static DRESULT wbcache_writeback(
+	int i
+)
+{
+	if (lba_write(spidisk->wb_buff[i], spidisk->wb_lba[i], 1)) return RES_ERROR;
+
+	spidisk->wb_lba[i] = SPI_WBCACHE_EMPTY;
+	spidisk->stat.cache_flush_count++;
+
+	return RES_OK;
+}
+
+// ܂Ăageȏdisk_writeo߂GgLBAɏ߂(age=0łׂ͂) 
+static DRESULT wbcache_flush(
+	DWORD age
+)
+{
+	int i,n;
+
+	while(1) {
+		n = -1;
+		for(i=0 ; i<SPI_WBCACHE_COUNT ; i++) {
+			if (spidisk->wb_lba[i] == SPI_WBCACHE_EMPTY) continue;
+			if (spidisk->wb_clock - spidisk->wb_dirty[i] < age) continue;
+			if (n < 0 || spidisk->wb_lba[i] < spidisk->wb_lba[n]) n = i;
+		}
+		if (n < 0) break;
+
+		if (wbcache_writeback(n)) return RES_ERROR;
+	}
+
+	return RES_OK;
+}
+
+// LBAZN^LbVɏ(󂫂Ȃꍇ͍ł܂ĂȂGgǂo) 
+static DRESULT wbcache_write(
+	const BYTE *buff,	/* Data to be written */
+	DWORD sector		/* Sector address in LBA */
+)
+{
+	int i,n;
+
+	if (sector >= spidisk->lba_count) return RES_PARERR;
+
+	i = wbcache_find(sector);
+
+	if (i >= 0) {
+		spidisk->stat.cache_hit_count++;
+	} else {
+		i = wbcache_find(SPI_WBCACHE_EMPTY);
+
+		if (i < 0) {
+			for(i=0, n=1 ; n<SPI_WBCACHE_COUNT ; n++) {
+				if (spidisk->wb_clock - spidisk->wb_used[n] > spidisk->wb_clock - spidisk->wb_used[i]) i = n;
+			}
+			if (wbcache_writeback(i)) return RES_ERROR;
+		}
+
+		spidisk->wb_lba[i] = sector;
+		spidisk->wb_dirty[i] = spidisk->wb_clock;
+	}
+
+	memcpy(spidisk->wb_buff[i], buff, SPI_SECTOR_SIZE);
+	spidisk->wb_used[i] = spidisk->wb_clock;
 
 	return RES_OK;
 }
+
+// ͈͓LBAZN^LbV̂Ă(Vf[^ŏ㏑EgȂȂꍇ) 
+static void wbcache_drop(
+	DWORD sector,		/* Start sector in LBA */
+	DWORD count			/* Number of sectors */
+)
+{
+	int i;
+
+	for(i=0 ; i<SPI_WBCACHE_COUNT ; i++) {
+		if (spidisk->wb_lba[i] != SPI_WBCACHE_EMPTY && spidisk->wb_lba[i] - sector < count) {
+			spidisk->wb_lba[i] = SPI_WBCACHE_EMPTY;
+		}
+	}
+}
 #endif
 
 
@@ -899,8 +3656,22 @@ DSTATUS disk_initialize (
 	if (disk_status(pdrv) & STA_NOINIT) {
 
 		if (spidisk_init()) return RES_NOTRDY;
+#if _USE_SPI_SATJNL
+		if (spidisk->mode == SPIDISK_FORMAT_STATIC && spidisk->jnl_count) {
+			if (sat_mount()) {
+				spidisk = NULL;
+				return RES_NOTRDY;
+			}
+		} else
+#endif
 #if _USE_SPI_SATCACHE
-		lba_satload();
+		if (spidisk->mode == SPIDISK_FORMAT_STATIC) lba_satload();
+#endif
+#if _USE_SPI_LOG
+		if (spidisk->mode == SPIDISK_FORMAT_LOG && ftl_mount()) {
+			spidisk = NULL;
+			return RES_NOTRDY;
+		}
 #endif
 	}
 
@@ -920,21 +3691,67 @@ DRESULT disk_read (
 	UINT count		/* Number of sectors to read */
 )
 {
-	DWORD offset;
+	DWORD offset, phy[SPI_READ_RUN];
+	UINT n, run;
+	DRESULT res;
+#if _USE_SPI_WBCACHE
+	int i;
+#endif
 
 	if (pdrv) return RES_PARERR;
 	if (spidisk == NULL) return RES_NOTRDY;
 
+	// ZN^NDMA]ɁAZN^N+1̕ZN^ԍ̎擾ƃLbVE蓖ăZN^ 
+	// obt@ւ̃Rs[sAZN^N+1̓]Jn钼OɃZN^N̊҂ 
+	res = RES_OK;
+	n = run = 0;
 	while(count) {
-		if (lba_getnumber(sector, &offset)) break;
-		if (read_physector(buff, offset)) break;
+		if (n >= run) {
+			run = (count < SPI_READ_RUN)? count : SPI_READ_RUN;
+
+			// SATLbVȂꍇSAT̓ǂݏoŃoXg߁Aɓ]̊҂ 
+			if (!(_USE_SPI_SATCACHE && spidisk->lba_table != NULL) && spi_sync()) {
+				res = RES_ERROR;
+				break;
+			}
+			if (lba_getrun(sector, run, phy)) {
+				res = RES_ERROR;
+				break;
+			}
+			n = 0;
+		}
+		offset = phy[n++];
+
+#if _USE_SPI_WBCACHE
+		i = wbcache_find(sector);
+		if (i >= 0) {
+			memcpy(buff, spidisk->wb_buff[i], SPI_SECTOR_SIZE);		// ߂ĂȂZN^̓LbVǂ 
+		} else
+#endif
+#if _USE_SPI_LOG
+		if (spidisk->mode == SPIDISK_FORMAT_LOG && offset == SPI_FTL_UNMAPPED) {
+			memset(buff, 0xff, SPI_SECTOR_SIZE);					// 蓖Ă̂ȂZN^͏Ԃœǂ 
+		} else
+#endif
+		{
+			if (spi_sync() || read_physector_async(buff, offset)) {
+				res = RES_ERROR;
+				break;
+			}
+		}
 
 		buff += SPI_SECTOR_SIZE;
 		sector++;
 		count--;
 	}
 
-	return count ? RES_ERROR : RES_OK;
+	if (spi_sync()) res = RES_ERROR;								// Ō̃ZN^̓]̊҂ 
+
+#if _USE_SPI_WRITE
+	spi_erase_resume();												// ǂݏô߂ɃTXyhĊJ 
+#endif
+
+	return res;
 }
 
 
@@ -951,24 +3768,31 @@ DRESULT disk_write (
 	UINT count			/* Number of sectors to write */
 )
 {
-	DWORD offset;
+	DRESULT res;
 
 	if (pdrv) return RES_PARERR;
 	if (spidisk == NULL) return RES_NOTRDY;
 
-	while(count) {
-		if (lba_getnumber(sector, &offset)) break;
-		if (write_physector(buff, offset)) {
-			if (lba_remap(sector)) break;
-			continue;
-		}
+	spidisk->stat.lba_write_count += count;
 
-		buff += SPI_SECTOR_SIZE;
-		sector++;
-		count--;
+#if _USE_SPI_WBCACHE
+	// 1ZN^̏(FATEfBNgEt@C̒[)̓LbVɕێ 
+	// ZN^݂̏̓LbVʂɏ 
+	spidisk->wb_clock++;
+
+	if (count == 1) {
+		res = wbcache_write(buff, sector);
+	} else {
+		wbcache_drop(sector, count);
+		res = lba_write(buff, sector, count);
 	}
 
-	return count ? RES_ERROR : RES_OK;
+	if (res == RES_OK && SPI_WBCACHE_AGE > 0) res = wbcache_flush(SPI_WBCACHE_AGE);
+#else
+	res = lba_write(buff, sector, count);
+#endif
+
+	return res;
 }
 #endif
 
@@ -985,6 +3809,12 @@ DRESULT disk_ioctl (
 )
 {
 	DRESULT res;
+#if _USE_SPI_WEARMOVE || (_USE_SPI_SATJNL && _USE_SPI_WRITE)
+	DWORD limit, n;
+#endif
+#if _USE_SPI_WEARMOVE
+	int i, m;
+#endif
 
 	if (spidisk == NULL) return RES_NOTRDY;
 
@@ -992,6 +3822,14 @@ DRESULT disk_ioctl (
 	switch (cmd) {
 		case CTRL_SYNC :		/* Make sure that no pending write process */
 			res = RES_OK;
+#if _USE_SPI_WBCACHE
+			res = wbcache_flush(0);
+			if (res) break;
+#endif
+#if _USE_SPI_WRITE && SPI_SCRUB_QUEUE > 0
+			scrub_physector();
+			res = scrub_repair();
+#endif
 			break;
 
 		case GET_SECTOR_COUNT :	/* Get number of sectors on the disk (DWORD) */
@@ -1009,6 +3847,89 @@ DRESULT disk_ioctl (
 			res = RES_OK;
 			break;
 
+#if _USE_SPI_WRITE
+		case CTRL_TRIM :		/* Inform device that the data on the block of sectors is no longer used */
+#if _USE_SPI_WBCACHE
+			wbcache_drop(((DWORD*)buff)[0], ((DWORD*)buff)[1] - ((DWORD*)buff)[0] + 1);
+#endif
+			res = lba_trim(((DWORD*)buff)[0], ((DWORD*)buff)[1]);
+			break;
+#endif
+
+#if _USE_SPI_WBCACHE || _USE_SPI_ERASEPOOL || _USE_SPI_WEARMOVE || (_USE_SPI_SATJNL && _USE_SPI_WRITE)
+		case SPIDISK_CTRL_IDLE :	/* Write back the cache and erase discarded sectors in idle time (DWORD) */
+			res = RES_OK;
+#if _USE_SPI_WBCACHE
+			res = wbcache_flush(0);
+			if (res) break;
+#endif
+#if _USE_SPI_WEARMOVE || (_USE_SPI_SATJNL && _USE_SPI_WRITE)
+			limit = *(DWORD*)buff;
+			n = 0;
+ #if _USE_SPI_ERASEPOOL
+			n = pool_idle(limit);
+ #endif
+ #if _USE_SPI_WEARMOVE
+
+			// ҂c͈̏̔͂ŐÓIEFAxOs 
+			for(i=0 ; spidisk->mode == SPIDISK_FORMAT_LOG && i<SPI_WEAR_MOVES && (limit == 0 || n < limit) ; i++, n++) {
+				m = ftl_migrate();
+				if (m <= 0) {
+					if (m < 0) res = RES_ERROR;
+					break;
+				}
+			}
+ #endif
+ #if _USE_SPI_SATJNL
+
+			// c͈̏̔͂ŃW[iSATɏݍ 
+			if (res == RES_OK && spidisk->mode == SPIDISK_FORMAT_STATIC && (limit == 0 || n < limit)) {
+				if (sat_fold(limit ? limit - n : 0) < 0) res = RES_ERROR;
+			}
+ #endif
+#elif _USE_SPI_ERASEPOOL
+			pool_idle(*(DWORD*)buff);
+#endif
+#if _USE_SPI_ERASEPOOL
+			*(DWORD*)buff = spidisk->pool_dirty_count;
+#else
+			*(DWORD*)buff = 0;
+#endif
+			break;
+#endif
+
+#if _USE_SPI_LOG
+		case SPIDISK_GET_WEAR :	/* Get erase count distribution of the log-structured volume (DEF_SPIDISKWEAR) */
+			res = ftl_getwear((DEF_SPIDISKWEAR*)buff);
+			break;
+#endif
+
+		case SPIDISK_GET_STAT :	/* Get write statistics (DEF_SPIDISKSTAT) */
+			*(DEF_SPIDISKSTAT*)buff = spidisk->stat;
+			res = RES_OK;
+			break;
+
+		case SPIDISK_CLEAR_STAT :	/* Clear write statistics */
+			memset(&spidisk->stat, 0, sizeof(DEF_SPIDISKSTAT));
+			res = RES_OK;
+			break;
+
+		case SPIDISK_GET_VERIFY :	/* Get verify policy (DEF_SPIVERIFY) */
+			*(DEF_SPIVERIFY*)buff = spidisk->verify;
+			res = RES_OK;
+			break;
+
+		case SPIDISK_SET_VERIFY :	/* Set verify policy (DEF_SPIVERIFY) */
+			if (((DEF_SPIVERIFY*)buff)->policy > SPIDISK_VERIFY_NONE) {
+				res = RES_PARERR;
+				break;
+			}
+			spidisk->verify = *(DEF_SPIVERIFY*)buff;
+			if (spidisk->verify.interval == 0) spidisk->verify.interval = 1;
+			spidisk->verify_phase = 0;
+			res = RES_OK;
+			break;
+
 		default:
 			res = RES_PARERR;
 	}
@@ -40,25 +40,103 @@ extern "C" {
 #endif
 
 #include "fatfs/diskio.h"
-#include <system.h>
 
 
 /*-----------------------------------------------------------------------*/
 /* Configuration                                                         */
 /*-----------------------------------------------------------------------*/
 
-// SPIRg[AhX(PERIDOT SWI EPCS/EPCQANZX|[g 
-#define SPI_DEV					(PERIDOT_HOSTBRIDGE_BASE + 0x14)
-
 // ZN^C[X/y[WvO̍ő҂(msP)
 #define SPI_ERASE_WAIT_MAX		(500)
 
+// SFDPɎԏ񂪂Ȃꍇ̃y[WvÕ|[OԊu(usP) 
+#define SPI_PROGRAM_POLL_US		(100)
+
+// DMA]̊Cxg҂̃^CAEg(usPʁEoߌ͊tOĊmF) 
+#define SPI_DMA_WAIT_US			(1000)
+
 // LBAϊe[uLbV̗L : 1=p / 0=Ȃ 
 #define _USE_SPI_SATCACHE		1
 
 // SPI FlashfoCX̎F : 1= / 0=Ȃ 
 #define _USE_SPI_AUTODETECT		1
 
+// f[^ǂݏoR}h : 1=FAST_READ(0x0b/0x0c)g / 0=READ(0x03/0x13)g 
+#define _USE_SPI_FASTREAD		1
+
+// ubN(32kB/64kB) : 1=foCXΉĂΎg / 0=gȂ 
+#define _USE_SPI_BLOCKERASE		1
+
+// O\̃{[ : 1=SPIDISK_FORMAT_LOGŃtH[}bg{[g / 0=Œ芄蓖Ẵ{[̂ 
+// (LBAϊe[uɒu_USE_SPI_SATCACHE1̏ꍇ̂ݗLEW[i̕vOɂĂ_USE_SPI_SKIPERASEQ) 
+#define _USE_SPI_LOGFTL			1
+
+// O\̃{[쐬Ƃ̃W[ĩZN^(2ȏE`FbN|Cg̊ԂɎĝ͂̐-1) 
+#define SPI_JOURNAL_SECTORS		(4)
+
+// Œ芄蓖Ẵ{[̑֏ : 1=SPIDISK_FORMAT_STATICŃW[it̃{[쐬AփZN^̊蓖ĂW[iɒǋL / 0=SATZN^ 
+// (LBAϊe[uɒu_USE_SPI_SATCACHE1̏ꍇ̂ݗLER[h̕vOɂĂ_USE_SPI_SKIPERASEQ) 
+#define _USE_SPI_SATJOURNAL		1
+
+// IEFAxO : ݐIԂƂɏ񐔂ׂ󂫃ZN^̐(0=ŏɌ󂫃ZN^ɏ) 
+#define SPI_WEAR_WINDOW			(32)
+
+// ς݂̃ZN^(v[)D悷񐔂̍ 
+#define SPI_WEAR_SLACK			(16)
+
+// ÓIEFAxO : 񐔂̍̒lȏɂȂASPIDISK_CTRL_IDLEŏ񐔂ŏ̃f[^񐔂ő̋󂫃ZN^Ɉڂ(0=ڂȂ) 
+#define SPI_WEAR_THRESHOLD		(64)
+
+// 1SPIDISK_CTRL_IDLEňڂZN^̏(1ZN^ɂőŏ11ZN^̓ǂݏoEvO) 
+#define SPI_WEAR_MOVES			(1)
+
+// ς݃ZN^̃v[ : CTRL_TRIMŒʒmꂽZN^(O\ł͎gȂȂZN^)SPIDISK_CTRL_IDLEŏĂ(0=gȂ) 
+// (Œ芄蓖Ẵ{[łffconf.h_USE_TRIM1̏ꍇ̂݃ZN^BDEF_SPIDISK1ZN^4oCg) 
+#define SPI_ERASE_POOL			(64)
+
+// CgobNLbV : 1ZN^݂̏ێĂZN^(0=gȂEdisk_write߂_ŏݍς) 
+// (CTRL_SYNCELbV̒ǂoESPI_WBCACHE_AGĚo߂LBAɃtbVɏ߂) 
+// 0ȊOɂƁAdisk_writeI݂łCTRL_SYNC܂łɓd؂Ǝ 
+// ܂ADEF_SPIDISK1ZN^4koCg̃obt@ 
+#define SPI_WBCACHE_COUNT		(0)
+
+// CgobNLbV߂܂łdisk_writẻ(0=񐔂ł͏߂Ȃ) 
+// (oߎԂł͂Ȃ݂̉񐔂Ő̂ŁȀ݂ȂCTRL_SYNCSPIDISK_CTRL_IDLE܂ŏ߂Ȃ) 
+#define SPI_WBCACHE_AGE			(64)
+
+// disk_readł܂Ƃ߂LBAϊZN^(X^bNɂ̐~4oCgg) 
+// (SATLbVȂꍇ͂̐SATGg1̓ǂݏoŎ擾) 
+#define SPI_READ_RUN			(16)
+
+// TXyh : 1=foCXΉĂΎs̏TXyhēǂݏo / 0=̊҂ 
+#define _USE_SPI_SUSPEND		1
+
+// Aǂݏo[h(0-4-4) : 1=foCXΉĂΎg / 0=gȂ 
+#define _USE_SPI_CONTINUOUSREAD	1
+
+// }bvǂݏo : 1=C^[tF[XΉĂΎg / 0=gȂ 
+#define _USE_SPI_MAPPEDREAD		1
+
+// ̏ȗ : 1=݂0ɂrbg̏ꍇ͏ɃvO / 0=ς݂̃ZN^ȊO͏ 
+// (ς݂̃ZN^ւ݂̏͏1ڂ̃vOȂ̂ŁA0łȗ) 
+// (y[Wւ̍ăvOfoCXł̂1ɂBECCfoCXȂǂł0̂܂܂ɂ) 
+// (0łASATW[iEO\̃W[ĩR[hƑփZN^̎gp}bv̓vOς݂̃y[W̏Ԃ̃oCgɒǋLB 
+//  oCg2vO邱Ƃ͂ȂA1y[Wւ̕̕vOłȂfoCXł_USE_SPI_SATJOURNALE_USE_SPI_LOGFTL0ɂB 
+//  gp}bv͑փZN^蓖Ă邲ƂɃfBXNZN^1oCgvO) 
+#define _USE_SPI_SKIPERASE		0
+
+// ݂̏ȗ : 1=eςȂZN^Ey[W͏܂Ȃ / 0=ɏ 
+#define _USE_SPI_WRITEELISION	1
+
+// y[WvÕxt@C@̏l(SPIDISK_VERIFY_xxxEdisk_ioctlŕύXł) 
+#define SPI_VERIFY_POLICY		SPIDISK_VERIFY_FULL
+
+// TvOxt@C̊Ԋȕl(y[W) 
+#define SPI_VERIFY_INTERVAL		(16)
+
+// xt@CȂ̏ꍇɌŃxt@C(XNu)ZN^̐(0=XNuȂ) 
+#define SPI_SCRUB_QUEUE			(16)
+
 // FȂꍇ̗eʒl(oCg) 
 #define SPI_FLASH_MEMSIZE		(16*1024*1024/8)
 
@@ -68,6 +146,86 @@ extern "C" {
 /* Function prototype                                                    */
 /*-----------------------------------------------------------------------*/
 
+typedef struct {
+	BYTE opcode;			// R}hoCg 
+	BYTE no_opcode;			// 1=R}hoCg𑗂Ȃ(Aǂݏo[h) 
+	BYTE addr_bytes;		// AhXtF[ỸoCg(0/3/4) 
+	BYTE addr_width;		// AhXE_~[tF[ỸoX(1/2/4) 
+	BYTE data_width;		// f[^tF[ỸoX(1/2/4) 
+	BYTE dummy_clocks;		// _~[TCÑNbN 
+	BYTE mode_bits;			// _~[TCN̐擪8rbgő郂[hrbg(ʏ0xff) 
+	DWORD address;			// AhX 
+	const BYTE *txbuff;		// Mf[^(NULL̏ꍇ0xff𑗐M) 
+	BYTE *rxbuff;			// Mf[^̊i[(NULL̏ꍇ͔j) 
+	DWORD length;			// f[^tF[ỸoCg 
+} DEF_SPICOMMAND;
+
+typedef struct {
+	void (*select)(void *context, BYTE assert);					// `bvZNg(1=AT[g / 0=lQ[g) 
+	BYTE (*transfer)(void *context, BYTE send);					// 1oCg̑M 
+	DRESULT (*burst)(void *context, const DEF_SPICOMMAND *cmd);	// o[Xg](NULL=1oCg]ŃG~[g) 
+	DRESULT (*dma)(void *context, const DEF_SPICOMMAND *cmd,	// DMA](NULL=gȂ) 
+					void (*complete)(void *arg, DRESULT res), void *arg);
+	void (*delay)(void *context, DWORD usec);					// ԑ҂(NULL=usleep) 
+	void (*wait)(void *context, DWORD usec);					// Cxg҂(NULL=|[O) 
+	void (*signal)(void *context);								// Cxg̒ʒm(荞݂Ă΂) 
+	const BYTE *(*map)(void *context, BYTE enable);				// }bv[h̐؂ւ(NULL=gȂ) 
+	void (*invalidate)(void *context, DWORD address, DWORD length);	// ͈͂̃LbV(NULL=sv) 
+	BYTE buswidth;												// burst/dmaŎgf[^̐(1/2/4) 
+} DEF_SPIDISK_IF;
+
+typedef struct {
+	DWORD typ_us;			// SFDP̕W(0=s) 
+	DWORD max_us;			// ^CAEg 
+	DWORD poll_us;			// \Ԃ߂Ẵ|[OԊu 
+	DWORD avg_us;			// Ԃ̈ړ(\) 
+	DWORD last_us;			// Ō̎ 
+	DWORD count;			// ҂̉ 
+} DEF_SPIBUSYTIME;
+
+typedef struct {
+	DWORD write_count;		// ZN^݂̉ 
+	DWORD erase_count;		// ZN^̉ 
+	DWORD erase_skip_count;	// ȗZN^݂̉ 
+	DWORD block_erase_count;	// ubN̉ 
+	DWORD program_count;	// y[WvỎ 
+	DWORD elide_count;		// eςȂߏȗZN^݂̉ 
+	DWORD elide_bytes;		// ݂ȗoCg(ȗZN^уy[W) 
+	DWORD blank_page_count;	// SoCg0xffŃvOȗy[W̐ 
+	DWORD verify_count;		// xt@Cy[W(CRCуXNu̓ZN^)̐ 
+	DWORD verify_error_count;	// xt@CG[̉ 
+	DWORD scrub_error_count;	// XNuŃxt@CG[ɂȂZN^̐ 
+	DWORD scrub_error_sector;	// ŌɃXNuŃxt@CG[ɂȂZN^ 
+	DWORD trim_erase_count;	// CTRL_TRIMŏZN^̐ 
+	DWORD pool_hit_count;	// v[ŏς݂̃ZN^ւ݂̏̉ 
+	DWORD pool_miss_count;	// ݎɏKv 
+	DWORD lba_write_count;	// disk_writeŏ܂ꂽLBAZN^̐ 
+	DWORD cache_hit_count;	// CgobNLbVŏꂽZN^̐ 
+	DWORD cache_flush_count;	// CgobNLbV珑߂ZN^̐ 
+	DWORD suspend_count;	// ǂݏô߂ɏTXyh 
+	DWORD ftl_write_count;	// O\ŋ󂫃ZN^ɒǋL 
+	DWORD journal_count;	// W[iɒǋLR[h̐ 
+	DWORD checkpoint_count;	// `FbN|Cg񂾉 
+	DWORD wear_move_count;	// ÓIEFAxOŃf[^ڂ 
+	DWORD sat_fold_count;	// W[iSATɏݍ񂾃ZN^ 
+} DEF_SPIDISKSTAT;
+
+typedef struct {
+	WORD sector_count;		// f[^p̕ZN^̐ 
+	WORD free_count;		// 󂫃ZN^̐ 
+	WORD bad_count;			// sǃZN^̐ 
+	WORD min_count;			// 񐔂̍ŏl 
+	WORD max_count;			// 񐔂̍ől 
+	WORD min_sector;		// 񐔂ŏ̕ZN^ 
+	WORD max_sector;		// 񐔂ő̕ZN^ 
+	DWORD total_count;		// 񐔂̍v(sǃZN^) 
+} DEF_SPIDISKWEAR;
+
+typedef struct {
+	BYTE policy;			// xt@C@(SPIDISK_VERIFY_xxx) 
+	WORD interval;			// TvOxt@C̊Ԋu(y[W) 
+} DEF_SPIVERIFY;
+
 typedef struct {
 	DWORD storage_size;		// fBXNC[W̃TCY(oCgEubNP) 
 	DWORD top_address;		// fBXNC[W̐擪AhX(TCYEɍ킹) 
@@ -78,13 +236,109 @@ typedef struct {
 	WORD lba_count;			// _ZN^̐ 
 	WORD *lba_table;		// LBAϊe[uւ̃|C^iLbVlj 
 	WORD last_rsv_sector;	// ŌɊ蓖ĂꂽփZN^iLbVlj 
+	DWORD info_address;		// fBXNZN^̃AhX 
+	BYTE mode;				// {[`(SPIDISK_FORMAT_xxx) 
+#if _USE_SPI_LOGFTL || _USE_SPI_SATJOURNAL
+	WORD jnl_top_sector;	// W[i̐擪ItZbgZN^ 
+	WORD jnl_count;			// W[ĩZN^(0=W[iȂ) 
+	WORD jnl_sector;		// ǋL̃W[iZN^(0`jnl_count-1) 
+	WORD jnl_record;		// ɒǋL郌R[ḧʒu 
+#endif
+#if _USE_SPI_SATJOURNAL
+	BYTE sat_dirty[5];		// W[iݍłȂSATZN^̃rbg}bv(ő33ZN^) 
+#endif
+#if _USE_SPI_LOGFTL
+	WORD data_count;		// f[^p̕ZN^̐ 
+	WORD ckp_count;			// `FbN|Cg1̃ZN^ 
+	WORD jnl_seq;			// ǋL̃W[iZN^̃V[PXԍ 
+	WORD jnl_used;			// `FbN|CggW[iZN^̐ 
+	BYTE ckp_base;			// Lȃ`FbN|Cg(0/1) 
+	WORD *phy_table;		// ZN^̏(0xffff=sǃZN^) 
+	BYTE *used_map;			// gp̕ZN^̃rbg}bv 
+	WORD free_count;		// 󂫕ZN^̐ 
+	WORD alloc_sector;		// ɋ󂫂𒲂ׂ镨ZN^ 
+#endif
+	BYTE read_cmd;			// f[^ǂݏoR}h(3oCgAhX) 
+	BYTE read_cmd4;			// f[^ǂݏoR}h(4oCgAhX) 
+	BYTE read_dummy;		// f[^ǂݏõ_~[TCN([hNbN܂) 
+	BYTE read_addr_width;	// f[^ǂݏõAhX(1/2/4) 
+	BYTE read_data_width;	// f[^ǂݏõf[^(1/2/4) 
+	BYTE read_mode_bits;	// Aǂݏo[hɓ郂[hrbg(0xff=gȂ) 
+	BYTE read_continuous;	// foCXAǂݏo[hɓĂ(0=Ȃ / 3,4=AhX̃oCg) 
+	DEF_SPIBUSYTIME erase_time;		// ZN^̊҂ 
+	DEF_SPIBUSYTIME program_time;	// y[WvO̊҂ 
+	BYTE block_cmd[2];		// ubNR}h(3oCgAhXA[0]=32kB / [1]=64kBA0=gȂ) 
+	BYTE block_cmd4[2];		// ubNR}h(4oCgAhX) 
+	DEF_SPIBUSYTIME block_time[2];	// ubN̊҂ 
+	const DEF_SPIDISK_IF *spi_if;	// SPI}X^C^[tF[X 
+	void *spi_context;		// SPI}X^C^[tF[X̃ReLXg 
+	const BYTE *map_base;	// }bvǂݏõx[XAhX(NULL=R}h[h) 
+	BYTE suspend_cmd;		// TXyhR}h(0=gȂ) 
+	BYTE resume_cmd;		// W[R}h 
+	DWORD suspend_us;		// TXyh̍ő҂(us) 
+	DWORD resume_us;		// W[玟̃TXyh܂ł̍ŏԊu(us) 
+	DWORD erase_address;	// ҂ɖ߂̐擪AhX 
+	DWORD erase_size;		// ҂ɖ߂̃TCY(0=Ȃ) 
+	DEF_SPIBUSYTIME *erase_busy;	// ҂ɖ߂̊҂ 
+	BYTE erase_state;		// ̏(0=s / 1=TXyh / 2=W[) 
+#if SPI_WBCACHE_COUNT > 0
+	DWORD wb_clock;			// disk_writẻ(߂̌oߎԂ̑) 
+	DWORD wb_lba[SPI_WBCACHE_COUNT];	// LbVĂLBAZN^(0xffffffff=) 
+	DWORD wb_dirty[SPI_WBCACHE_COUNT];	// ŏɏ܂ꂽƂwb_clock 
+	DWORD wb_used[SPI_WBCACHE_COUNT];	// Ōɏ܂ꂽƂwb_clock 
+	BYTE wb_buff[SPI_WBCACHE_COUNT][4096];	// LbVĂZN^̃f[^(4koCg/ZN^) 
+#endif
+#if SPI_ERASE_POOL > 0
+	WORD pool_dirty_count;	// ҂̃ZN^ 
+	WORD pool_dirty[SPI_ERASE_POOL];	// ҂̕ZN^(CTRL_TRIMŒʒmꂽZN^) 
+	WORD pool_clean_count;	// ς݂̃ZN^ 
+	WORD pool_clean[SPI_ERASE_POOL];	// ς݂̕ZN^ 
+#endif
+	DEF_SPIDISKSTAT stat;	// ݂̓v 
+	DEF_SPIVERIFY verify;	// xt@C@ 
+	WORD verify_phase;		// TvOxt@C̃y[WJE^ 
+#if SPI_SCRUB_QUEUE > 0
+	WORD scrub_count;		// XNu҂̃ZN^ 
+	WORD scrub_sector[SPI_SCRUB_QUEUE];	// XNu҂̕ZN^ 
+	WORD scrub_crc[SPI_SCRUB_QUEUE];	// XNu҂̃ZN^CRC 
+	WORD scrub_failed_count;	// XNuŃG[ɂȂACTRL_SYNCőւZN^ 
+	WORD scrub_failed[SPI_SCRUB_QUEUE];	// XNuŃG[ɂȂZN^ 
+#endif
 } DEF_SPIDISK;
 
 
+// disk_ioctl̊gR}h 
+#define SPIDISK_GET_STAT		(100)	// ݂̓v擾(DEF_SPIDISKSTAT) 
+#define SPIDISK_CLEAR_STAT		(101)	// ݂̓vNA 
+#define SPIDISK_GET_VERIFY		(102)	// xt@C@擾(DEF_SPIVERIFY) 
+#define SPIDISK_SET_VERIFY		(103)	// xt@C@ݒ肷(DEF_SPIVERIFY) 
+#define SPIDISK_CTRL_IDLE		(104)	// ACh̏s(DWORD : =ő(0=ׂ) / o=c̏҂) 
+												// (CgobNLbVׂ͂ď߂A҂ȂȂSATւ̏ݍ݂ƐÓIEFAxOs) 
+#define SPIDISK_GET_WEAR		(105)	// ZN^̏񐔂̕z擾(DEF_SPIDISKWEAREO\̃{[̂) 
+
+// {[` 
+#define SPIDISK_FORMAT_STATIC	(0)		// Œ芄蓖(LBAƂɕZN^Œ肵A݃G[őփZN^Ɋ蓖Ă) 
+#define SPIDISK_FORMAT_LOG		(1)		// O\(݂Ƃɋ󂫃ZN^ɒǋLAÂZN^͏čėp) 
+
+// xt@C@ 
+#define SPIDISK_VERIFY_FULL		(0)		// Sy[WǂݏoĔr 
+#define SPIDISK_VERIFY_CRC		(1)		// ZN^񂾌ɓǂݏoCRCr 
+#define SPIDISK_VERIFY_SAMPLED	(2)		// intervaly[WƂ1y[WǂݏoĔr 
+#define SPIDISK_VERIFY_NONE		(3)		// xt@CȂ(SPI_SCRUB_QUEUEZN^CTRL_SYNCŃXNuAG[̃ZN^ւ) 
+
+
+
 // SPIfBXNtH[}bg 
 DRESULT spidisk_format(
 	DWORD disksize,			// 蓖ăfBXNTCY(oCg) 
-	WORD rsv_count			// \ZN^ 
+	WORD rsv_count,			// \ZN^(O\ł͋󂫃ZN^ƂĎg) 
+	BYTE mode				// {[`(SPIDISK_FORMAT_xxx) 
+);
+
+// SPI}X^C^[tF[X̓o^ 
+DRESULT spidisk_register(
+	const DEF_SPIDISK_IF *spi_if,	// SPI}X^C^[tF[X 
+	void *context					// C^[tF[XɓnReLXg 
 );
 
 
@@ -0,0 +1,133 @@
+// ------------------------------------------------------------------- //
+//  PERIDOT-NGS SPI flash Filesystem (Hostbridge SPI interface)        //
+// ------------------------------------------------------------------- //
+//
+//  ver 0.91
+//		2017/03/11	s.osafune@gmail.com
+//
+// ******************************************************************* //
+//  The MIT License (MIT)
+//  Copyright (c) 2017 J-7SYSTEM WORKS LIMITED.
+//
+//  Permission is hereby granted, free of charge, to any person
+//  obtaining a copy of this software and associated documentation
+//  files (the "Software"), to deal in the Software without restriction,
+//  including without limitation the rights to use, copy, modify, merge,
+//  publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be
+//  included in all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+//  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+//  NONINFRINGEMENT.
+//  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+//  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+//  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// ******************************************************************* //
+
+
+#include <stddef.h>
+#include <system.h>
+#include <io.h>
+#include "spidisk.h"
+#include "spidisk_hostbridge.h"
+
+
+/*-----------------------------------------------------------------------*/
+/* Configuration                                                         */
+/*-----------------------------------------------------------------------*/
+
+// SPIRg[AhX(PERIDOT SWI EPCS/EPCQANZX|[g) 
+#define SPI_DEV					(PERIDOT_HOSTBRIDGE_BASE + 0x14)
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Define a macro                                                        */
+/*-----------------------------------------------------------------------*/
+
+#define SPI_SS_ASSERT			(1<<8)
+#define SPI_SS_NEGATE			((0<<8)|0xff)
+#define SPI_TRANS_START			(1<<9)
+#define SPI_TRANS_READY			(1<<9)
+
+#define SPI_BASE(_ctx)			((_ctx) != NULL ? (DWORD)(_ctx) : (DWORD)(SPI_DEV))
+
+
+
+/*-----------------------------------------------------------------------*/
+/* SPI master peripheral handler                                         */
+/*-----------------------------------------------------------------------*/
+
+// SPI}X^ytF̒ʐM҂ 
+// 1oCg̓]͐sŊ邽߁Ã^XNɂ͏炸Ƀ|[O 
+static DWORD spi_waitready(
+	DWORD base
+)
+{
+	DWORD res;
+
+	do {
+		res = IORD(base, 0);
+	} while( !(res & SPI_TRANS_READY) );
+
+	return res;
+}
+
+// SPI}X^1oCg̑Ms 
+static DWORD spi_transaction(
+	DWORD base,
+	DWORD send
+)
+{
+	IOWR(base, 0, SPI_TRANS_START | send);
+	return spi_waitready(base);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* SPI-disk interface                                                    */
+/*-----------------------------------------------------------------------*/
+
+// `bvZNg̓oCgSSrbgŐ䂷 
+// lQ[g̓`bvZNg̍ŒlQ[gԂ𖞂߁ASS_nlQ[gԂ1oCg̖gUNV𔭍s 
+static void hostbridge_select(
+	void *context,
+	BYTE assert
+)
+{
+	if (assert) {
+		spi_waitready(SPI_BASE(context));
+	} else {
+		spi_transaction(SPI_BASE(context), SPI_SS_NEGATE);
+	}
+}
+
+static BYTE hostbridge_transfer(
+	void *context,
+	BYTE send
+)
+{
+	return spi_transaction(SPI_BASE(context), SPI_SS_ASSERT | send) & 0xff;
+}
+
+
+const DEF_SPIDISK_IF spidisk_if_hostbridge = {
+	hostbridge_select,
+	hostbridge_transfer,
+	NULL,					// o[Xg]1oCg]ŃG~[g 
+	NULL,
+	NULL,
+	NULL,					// 荞݂͂Ȃߊ҂̓|[O 
+	NULL,
+	NULL,					// }bvǂݏo͔Ή 
+	NULL,
+	1
+};
@@ -0,0 +1,56 @@
+// ------------------------------------------------------------------- //
+//  PERIDOT-NGS SPI flash Filesystem (Hostbridge SPI interface)        //
+// ------------------------------------------------------------------- //
+//
+//  ver 0.91
+//		2017/03/11	s.osafune@gmail.com
+//
+// ******************************************************************* //
+//  The MIT License (MIT)
+//  Copyright (c) 2017 J-7SYSTEM WORKS LIMITED.
+//
+//  Permission is hereby granted, free of charge, to any person
+//  obtaining a copy of this software and associated documentation
+//  files (the "Software"), to deal in the Software without restriction,
+//  including without limitation the rights to use, copy, modify, merge,
+//  publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be
+//  included in all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+//  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+//  NONINFRINGEMENT.
+//  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+//  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+//  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// ******************************************************************* //
+
+
+
+#ifndef _SPIDISK_HOSTBRIDGE_DEFINED
+#define _SPIDISK_HOSTBRIDGE_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "spidisk.h"
+
+
+// PERIDOT Hostbridge SPI}X^C^[tF[X 
+// contextɂSPIRg[̃AhXn(NULL̏ꍇSPI_DEVg) 
+extern const DEF_SPIDISK_IF spidisk_if_hostbridge;
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
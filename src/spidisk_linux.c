@@ -0,0 +1,298 @@
+// ------------------------------------------------------------------- //
+//  PERIDOT-NGS SPI flash Filesystem (Linux spidev SPI interface)      //
+// ------------------------------------------------------------------- //
+//
+//  ver 0.91
+//		2017/03/11	s.osafune@gmail.com
+//
+// ******************************************************************* //
+//  The MIT License (MIT)
+//  Copyright (c) 2017 J-7SYSTEM WORKS LIMITED.
+//
+//  Permission is hereby granted, free of charge, to any person
+//  obtaining a copy of this software and associated documentation
+//  files (the "Software"), to deal in the Software without restriction,
+//  including without limitation the rights to use, copy, modify, merge,
+//  publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be
+//  included in all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+//  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+//  NONINFRINGEMENT.
+//  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+//  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+//  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// ******************************************************************* //
+
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/spi/spidev.h>
+#include "spidisk.h"
+#include "spidisk_linux.h"
+
+
+/*-----------------------------------------------------------------------*/
+/* Define a macro                                                        */
+/*-----------------------------------------------------------------------*/
+
+#define SPIDEV_HEADER_MAX		(1+4+8)		// R}h{AhX{_~[̍őoCg 
+#define SPIDEV_XFER_MAX			(3)			// 1bZ[W̍ő] 
+
+
+
+/*-----------------------------------------------------------------------*/
+/* spidev message handler                                                */
+/*-----------------------------------------------------------------------*/
+
+// bZ[W𑗐M 
+static int linux_message(
+	DEF_SPIDISK_LINUX *dev,
+	struct spi_ioc_transfer *xfer,
+	UINT count
+)
+{
+	dev->message_count++;
+	dev->transfer_count += count;
+
+	if (dev->message != NULL) return dev->message(dev, xfer, count);
+
+	return ioctl(dev->fd, SPI_IOC_MESSAGE(count), xfer);
+}
+
+// ]fBXNv^ݒ肷 
+static void linux_setxfer(
+	DEF_SPIDISK_LINUX *dev,
+	struct spi_ioc_transfer *xfer,
+	const BYTE *tx,
+	BYTE *rx,
+	DWORD len,
+	BYTE width
+)
+{
+	memset(xfer, 0, sizeof(struct spi_ioc_transfer));
+	xfer->tx_buf = (unsigned long)tx;
+	xfer->rx_buf = (unsigned long)rx;
+	xfer->len = len;
+	xfer->speed_hz = dev->speed_hz;
+	xfer->bits_per_word = 8;
+	xfer->tx_nbits = (tx != NULL)? width : 0;
+	xfer->rx_nbits = (rx != NULL)? width : 0;
+}
+
+
+int spidisk_linux_loopback(
+	DEF_SPIDISK_LINUX *dev,
+	struct spi_ioc_transfer *xfer,
+	UINT count
+)
+{
+	UINT i;
+
+	for(i=0 ; i<count ; i++,xfer++) {
+		if (xfer->rx_buf == 0) continue;
+
+		if (xfer->tx_buf != 0) {
+			memcpy((void *)(unsigned long)xfer->rx_buf, (const void *)(unsigned long)xfer->tx_buf, xfer->len);
+		} else {
+			memset((void *)(unsigned long)xfer->rx_buf, 0x00, xfer->len);
+		}
+	}
+
+	return 0;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* SPI-disk interface                                                    */
+/*-----------------------------------------------------------------------*/
+
+// spidev̓bZ[WPʂŃ`bvZNg𐧌䂷邽߁A]cs_changeŃAT[gێA 
+// lQ[g͒0̓]ŃbZ[WIčs 
+// select/transfer̓G[ԂȂ߁AsbZ[W̖߂ldev->errorɕێ 
+static void linux_select(
+	void *context,
+	BYTE assert
+)
+{
+	DEF_SPIDISK_LINUX *dev = (DEF_SPIDISK_LINUX *)context;
+	struct spi_ioc_transfer xfer;
+	int res;
+
+	if (assert) return;
+
+	linux_setxfer(dev, &xfer, NULL, NULL, 0, 1);
+	res = linux_message(dev, &xfer, 1);
+	if (res < 0 && dev->error == 0) dev->error = res;
+}
+
+// G[̔̓`bvZNg̃lQ[g܂œ]sȂ 
+static BYTE linux_transfer(
+	void *context,
+	BYTE send
+)
+{
+	DEF_SPIDISK_LINUX *dev = (DEF_SPIDISK_LINUX *)context;
+	struct spi_ioc_transfer xfer;
+	BYTE recv = 0xff;
+	int res;
+
+	if (dev->error != 0) return 0xff;
+
+	linux_setxfer(dev, &xfer, &send, &recv, 1, 1);
+	xfer.cs_change = 1;					// bZ[WI`bvZNgێ 
+	res = linux_message(dev, &xfer, 1);
+	if (res < 0) dev->error = res;
+
+	return recv;
+}
+
+// R}hEAhXE_~[Ef[^1̃bZ[WőM 
+// bufsiz𒴂f[^͕̃bZ[WɕAŌȊOcs_changeŃ`bvZNgێ 
+static DRESULT linux_burst(
+	void *context,
+	const DEF_SPICOMMAND *cmd
+)
+{
+	DEF_SPIDISK_LINUX *dev = (DEF_SPIDISK_LINUX *)context;
+	struct spi_ioc_transfer xfer[SPIDEV_XFER_MAX];
+	BYTE header[SPIDEV_HEADER_MAX];
+	const BYTE *tx = cmd->txbuff;
+	BYTE *rx = cmd->rxbuff;
+	DWORD len, chunk, total;
+	UINT i, n, hlen;
+
+	// select/transferŎsbZ[W΃G[Ԃ 
+	if (dev->error != 0) {
+		dev->error = 0;
+		return RES_ERROR;
+	}
+
+	// R}hEAhXE_~[̃wb_ 
+	hlen = 0;
+	if (!cmd->no_opcode) header[hlen++] = cmd->opcode;
+	for(i=cmd->addr_bytes ; i>0 ; i--) {
+		header[hlen++] = (cmd->address >> ((i-1)*8))& 0xff;
+	}
+	n = (cmd->dummy_clocks * cmd->addr_width + 7) / 8;
+	for(i=0 ; i<n && hlen<SPIDEV_HEADER_MAX ; i++) {
+		header[hlen++] = (i == 0)? cmd->mode_bits : 0xff;		// 擪̓[hrbg 
+	}
+
+	n = 0;
+	if (cmd->addr_width == 1 || cmd->no_opcode) {
+		linux_setxfer(dev, &xfer[n++], header, NULL, hlen, cmd->addr_width);
+	} else {
+		linux_setxfer(dev, &xfer[n++], header, NULL, 1, 1);				// R}h̓VO 
+		linux_setxfer(dev, &xfer[n++], header+1, NULL, hlen-1, cmd->addr_width);
+	}
+	total = hlen;
+	len = cmd->length;
+
+	// f[^tF[Y 
+	while(1) {
+		chunk = SPIDEV_BUFSIZ - total;
+		if (chunk > len) chunk = len;
+
+		if (chunk > 0) {
+			linux_setxfer(dev, &xfer[n++], tx, rx, chunk, cmd->data_width);
+			if (tx != NULL) tx += chunk;
+			if (rx != NULL) rx += chunk;
+			len -= chunk;
+		}
+		xfer[n-1].cs_change = (len > 0)? 1 : 0;				// ꍇ̓`bvZNgێ 
+
+		if (linux_message(dev, xfer, n) < 0) return RES_ERROR;
+		if (len == 0) break;
+
+		n = 0;
+		total = 0;
+	}
+
+	return RES_OK;
+}
+
+
+static const DEF_SPIDISK_IF spidisk_if_linux = {
+	linux_select,
+	linux_transfer,
+	linux_burst,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	1
+};
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Open/Close spidev                                                     */
+/*-----------------------------------------------------------------------*/
+
+DRESULT spidisk_linux_open(
+	DEF_SPIDISK_LINUX *dev,
+	const char *path,
+	DWORD speed_hz,
+	BYTE buswidth
+)
+{
+	__u32 mode = SPI_MODE_0;
+	BYTE bits = 8;
+	__u32 speed = speed_hz;
+
+	dev->spi_if = spidisk_if_linux;
+	dev->spi_if.buswidth = buswidth;
+	dev->speed_hz = speed_hz;
+	dev->message = NULL;
+	dev->message_arg = NULL;
+	dev->message_count = 0;
+	dev->transfer_count = 0;
+	dev->error = 0;
+
+	if (buswidth >= 4) {
+		mode |= SPI_TX_QUAD | SPI_RX_QUAD;
+	} else if (buswidth >= 2) {
+		mode |= SPI_TX_DUAL | SPI_RX_DUAL;
+	}
+
+	if (path == NULL) {
+		dev->fd = -1;
+		dev->message = spidisk_linux_loopback;
+		return RES_OK;
+	}
+
+	dev->fd = open(path, O_RDWR);
+	if (dev->fd < 0) return RES_NOTRDY;
+
+	if (ioctl(dev->fd, SPI_IOC_WR_MODE32, &mode) < 0 ||
+			ioctl(dev->fd, SPI_IOC_WR_BITS_PER_WORD, &bits) < 0 ||
+			ioctl(dev->fd, SPI_IOC_WR_MAX_SPEED_HZ, &speed) < 0) {
+		close(dev->fd);
+		dev->fd = -1;
+		return RES_ERROR;
+	}
+
+	return RES_OK;
+}
+
+
+void spidisk_linux_close(
+	DEF_SPIDISK_LINUX *dev
+)
+{
+	if (dev->fd >= 0) close(dev->fd);
+	dev->fd = -1;
+}
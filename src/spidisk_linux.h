@@ -0,0 +1,100 @@
+// ------------------------------------------------------------------- //
+//  PERIDOT-NGS SPI flash Filesystem (Linux spidev SPI interface)      //
+// ------------------------------------------------------------------- //
+//
+//  ver 0.91
+//		2017/03/11	s.osafune@gmail.com
+//
+// ******************************************************************* //
+//  The MIT License (MIT)
+//  Copyright (c) 2017 J-7SYSTEM WORKS LIMITED.
+//
+//  Permission is hereby granted, free of charge, to any person
+//  obtaining a copy of this software and associated documentation
+//  files (the "Software"), to deal in the Software without restriction,
+//  including without limitation the rights to use, copy, modify, merge,
+//  publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be
+//  included in all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+//  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+//  NONINFRINGEMENT.
+//  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+//  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+//  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// ******************************************************************* //
+
+
+
+#ifndef _SPIDISK_LINUX_DEFINED
+#define _SPIDISK_LINUX_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <linux/spi/spidev.h>
+#include "spidisk.h"
+
+
+/*-----------------------------------------------------------------------*/
+/* Configuration                                                         */
+/*-----------------------------------------------------------------------*/
+
+// spidev1bZ[Wœ]łőoCg(spidevW[bufsizp[^) 
+#define SPIDEV_BUFSIZ			(4096)
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Function prototype                                                    */
+/*-----------------------------------------------------------------------*/
+
+typedef struct _DEF_SPIDISK_LINUX {
+	DEF_SPIDISK_IF spi_if;	// C^[tF[Xe[u(spidisk_registerɓn) 
+	int fd;					// spideṽt@CfBXNv^ 
+	DWORD speed_hz;			// SPINbNg(Hz) 
+	int (*message)(struct _DEF_SPIDISK_LINUX *dev, struct spi_ioc_transfer *xfer, UINT count);
+							// bZ[W̑M(NULL̏ꍇSPI_IOC_MESSAGEioctl) 
+	void *message_arg;		// message֐p̔CӃf[^ 
+	DWORD message_count;	// MbZ[W 
+	DWORD transfer_count;	// M] 
+	int error;				// select/transferŎsbZ[W̖߂l(0=ȂAburstRES_ERRORԂ0ɖ߂) 
+} DEF_SPIDISK_LINUX;
+
+
+// spidevfoCX̃I[v 
+// pathNULL̏ꍇ̓foCXJA[vobN(MOSIMISO)œ삷 
+DRESULT spidisk_linux_open(
+	DEF_SPIDISK_LINUX *dev,	// C^[tF[XReLXg 
+	const char *path,		// foCXt@C("/dev/spidevX.Y") 
+	DWORD speed_hz,			// SPINbNg(Hz) 
+	BYTE buswidth			// gpf[^̐(1/2/4) 
+);
+
+// spidevfoCX̃N[Y 
+void spidisk_linux_close(
+	DEF_SPIDISK_LINUX *dev
+);
+
+// [vobÑbZ[W(@Ȃł̊mFp) 
+int spidisk_linux_loopback(
+	DEF_SPIDISK_LINUX *dev,
+	struct spi_ioc_transfer *xfer,
+	UINT count
+);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
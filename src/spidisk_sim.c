@@ -0,0 +1,1006 @@
+// ------------------------------------------------------------------- //
+//  PERIDOT-NGS SPI flash Filesystem (SPI flash simulator)             //
+// ------------------------------------------------------------------- //
+//
+//  ver 0.91
+//		2017/03/11	s.osafune@gmail.com
+//
+// ******************************************************************* //
+//  The MIT License (MIT)
+//  Copyright (c) 2017 J-7SYSTEM WORKS LIMITED.
+//
+//  Permission is hereby granted, free of charge, to any person
+//  obtaining a copy of this software and associated documentation
+//  files (the "Software"), to deal in the Software without restriction,
+//  including without limitation the rights to use, copy, modify, merge,
+//  publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be
+//  included in all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+//  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+//  NONINFRINGEMENT.
+//  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+//  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+//  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// ******************************************************************* //
+
+
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "spidisk.h"
+#include "spidisk_sim.h"
+
+
+/*-----------------------------------------------------------------------*/
+/* Define a macro                                                        */
+/*-----------------------------------------------------------------------*/
+
+#define SIM_OP_NONE				(0)
+#define SIM_OP_READ				(1)
+#define SIM_OP_SFDP				(2)
+#define SIM_OP_PROGRAM			(3)
+#define SIM_OP_ERASE			(4)
+#define SIM_OP_CHIPERASE		(5)
+#define SIM_OP_RDSR				(6)
+#define SIM_OP_RDSR2			(7)
+#define SIM_OP_WRSR				(8)
+#define SIM_OP_WRSR2			(9)
+#define SIM_OP_WREN				(10)
+#define SIM_OP_WRDI				(11)
+#define SIM_OP_RDID				(12)
+#define SIM_OP_RSTEN			(13)
+#define SIM_OP_RST				(14)
+#define SIM_OP_ERASE32			(15)
+#define SIM_OP_ERASE64			(16)
+#define SIM_OP_SUSPEND			(17)
+#define SIM_OP_RESUME			(18)
+
+#define SIM_STATUS_WIP			(1<<0)
+#define SIM_STATUS_WEL			(1<<1)
+#define SIM_STATUS2_QE			(1<<1)
+
+#define SIM_ERASE_SIZE			(4096)
+#define SIM_TRST_NS				(30000)	// \tgEFAZbg̕A 
+
+#define SIM_SFDP_BFPT			(0x30)	// JEDEC{p[^e[ũAhX 
+#define SIM_SFDP_BFPT_DWORDS	(16)
+
+#define SIM_CLOCK_NS(_s,_c)		(((QWORD)(_c) * 1000000000) / (_s)->config.clock_hz)
+
+typedef struct {
+	BYTE opcode;
+	BYTE type;
+	BYTE addr_bytes;
+	BYTE addr_width;
+	BYTE data_width;
+	BYTE dummy_clocks;		// [hNbN܂ 
+} SIM_OPINFO;
+
+// ΉR}h(_~[NbNSFDP̃p[^ƈv) 
+static const SIM_OPINFO sim_optable[] = {
+	{0x03, SIM_OP_READ,      3, 1, 1, 0},
+	{0x13, SIM_OP_READ,      4, 1, 1, 0},
+	{0x0b, SIM_OP_READ,      3, 1, 1, 8},
+	{0x0c, SIM_OP_READ,      4, 1, 1, 8},
+	{0x3b, SIM_OP_READ,      3, 1, 2, 8},
+	{0x3c, SIM_OP_READ,      4, 1, 2, 8},
+	{0xbb, SIM_OP_READ,      3, 2, 2, 4},
+	{0xbc, SIM_OP_READ,      4, 2, 2, 4},
+	{0x6b, SIM_OP_READ,      3, 1, 4, 8},
+	{0x6c, SIM_OP_READ,      4, 1, 4, 8},
+	{0xeb, SIM_OP_READ,      3, 4, 4, 6},
+	{0xec, SIM_OP_READ,      4, 4, 4, 6},
+	{0x5a, SIM_OP_SFDP,      3, 1, 1, 8},
+	{0x02, SIM_OP_PROGRAM,   3, 1, 1, 0},
+	{0x12, SIM_OP_PROGRAM,   4, 1, 1, 0},
+	{0x20, SIM_OP_ERASE,     3, 1, 1, 0},
+	{0x21, SIM_OP_ERASE,     4, 1, 1, 0},
+	{0x52, SIM_OP_ERASE32,   3, 1, 1, 0},
+	{0x5c, SIM_OP_ERASE32,   4, 1, 1, 0},
+	{0xd8, SIM_OP_ERASE64,   3, 1, 1, 0},
+	{0xdc, SIM_OP_ERASE64,   4, 1, 1, 0},
+	{0xc7, SIM_OP_CHIPERASE, 0, 1, 1, 0},
+	{0x75, SIM_OP_SUSPEND,   0, 1, 1, 0},
+	{0x7a, SIM_OP_RESUME,    0, 1, 1, 0},
+	{0x60, SIM_OP_CHIPERASE, 0, 1, 1, 0},
+	{0x05, SIM_OP_RDSR,      0, 1, 1, 0},
+	{0x35, SIM_OP_RDSR2,     0, 1, 1, 0},
+	{0x01, SIM_OP_WRSR,      0, 1, 1, 0},
+	{0x31, SIM_OP_WRSR2,     0, 1, 1, 0},
+	{0x06, SIM_OP_WREN,      0, 1, 1, 0},
+	{0x04, SIM_OP_WRDI,      0, 1, 1, 0},
+	{0x9f, SIM_OP_RDID,      0, 1, 1, 0},
+	{0x66, SIM_OP_RSTEN,     0, 1, 1, 0},
+	{0x99, SIM_OP_RST,       0, 1, 1, 0}
+};
+
+
+
+/*-----------------------------------------------------------------------*/
+/* SFDP table                                                            */
+/*-----------------------------------------------------------------------*/
+
+// ԂSFDP(JEg+1)*Pʂ̌`ɕϊ 
+static DWORD sim_sfdp_time(
+	DWORD time,
+	const DWORD *units,
+	UINT unit_count,
+	UINT count_bits,
+	UINT *unit_sel
+)
+{
+	DWORD count;
+	UINT i;
+
+	for(i=0 ; i<unit_count ; i++) {
+		count = (time + units[i] - 1) / units[i];
+		if (count <= (1UL << count_bits) || i == unit_count-1) break;
+	}
+	if (count == 0) count = 1;
+	if (count > (1UL << count_bits)) count = 1UL << count_bits;
+	*unit_sel = i;
+
+	return count - 1;
+}
+
+static void sim_set_dword(
+	BYTE *p,
+	DWORD dw
+)
+{
+	p[0] = (dw >>  0)& 0xff;
+	p[1] = (dw >>  8)& 0xff;
+	p[2] = (dw >> 16)& 0xff;
+	p[3] = (dw >> 24)& 0xff;
+}
+
+// JESD216B`SFDP쐬 
+static void sim_build_sfdp(
+	DEF_SPIDISK_SIM *sim
+)
+{
+	static const DWORD erase_units[4] = {1000, 16000, 128000, 1000000};	// us 
+	static const DWORD pp_units[2] = {8, 64};							// us 
+	static const DWORD ce_units[4] = {16, 256, 4000, 64000};			// ms 
+	static const DWORD sus_units[1] = {1};								// us 
+	static const DWORD rs_units[1] = {64};								// us 
+	BYTE *p = sim->sfdp;
+	DWORD dw;
+	UINT unit;
+
+	memset(p, 0xff, SPISIM_SFDP_SIZE);
+
+	// SFDPwb_ 
+	p[0] = 'S'; p[1] = 'F'; p[2] = 'D'; p[3] = 'P';
+	p[4] = 0x06;							// JESD216B (1.6) 
+	p[5] = 0x01;
+	p[6] = 0x00;							// p[^wb_-1 
+	p[7] = 0xff;
+
+	// p[^wb_0 (JEDEC{p[^) 
+	p[8] = 0x00;
+	p[9] = 0x06;
+	p[10] = 0x01;
+	p[11] = SIM_SFDP_BFPT_DWORDS;
+	p[12] = (SIM_SFDP_BFPT >>  0)& 0xff;
+	p[13] = (SIM_SFDP_BFPT >>  8)& 0xff;
+	p[14] = (SIM_SFDP_BFPT >> 16)& 0xff;
+	p[15] = 0xff;
+
+	p += SIM_SFDP_BFPT;
+
+	// DWORD1 : 4kB(20h)AAhXoCgAǂݏõT|[g 
+	dw = 0xff800000 | (0x20 << 8) | (1<<2) | (1<<0);
+	if (sim->config.memsize > 16*1024*1024) dw |= (1<<17);			// 3oCg܂4oCg 
+	if (sim->config.buswidth >= 2) dw |= (1<<16) | (1<<20);			// 1-1-2, 1-2-2 
+	if (sim->config.buswidth >= 4) dw |= (1<<21) | (1<<22);			// 1-4-4, 1-1-4 
+	sim_set_dword(p + 0*4, dw);
+
+	// DWORD2 : e(rbg-1) 
+	sim_set_dword(p + 1*4, sim->config.memsize * 8 - 1);
+
+	// DWORD3 : 1-4-4(EBh, [h2, _~[4) / 1-1-4(6Bh, _~[8) 
+	sim_set_dword(p + 2*4, (0x6b << 24) | (0 << 21) | (8 << 16) | (0xeb << 8) | (2 << 5) | (4 << 0));
+
+	// DWORD4 : 1-1-2(3Bh, _~[8) / 1-2-2(BBh, [h4) 
+	sim_set_dword(p + 3*4, (0xbb << 24) | (4 << 21) | (0 << 16) | (0x3b << 8) | (0 << 5) | (8 << 0));
+
+	// DWORD5-7 : 2-2-2/4-4-4͔Ή 
+	sim_set_dword(p + 4*4, 0xffffffee);
+	sim_set_dword(p + 5*4, 0x0000ffff);
+	sim_set_dword(p + 6*4, 0x0000ffff);
+
+	// DWORD8-9 : ^Cv1 = 4kB(20h), ^Cv2 = 32kB(52h), ^Cv3 = 64kB(D8h) 
+	dw = (0x20 << 8) | 12;
+	if (sim->config.tbe32_us) dw |= (0x52 << 24) | (15 << 16);
+	sim_set_dword(p + 7*4, dw);
+	sim_set_dword(p + 8*4, (sim->config.tbe64_us)? (0xd8 << 8) | 16 : 0);
+
+	// DWORD10 : (ő=typ~2~(3+1)) 
+	dw = sim_sfdp_time(sim->config.tse_us, erase_units, 4, 5, &unit);
+	dw = (unit << 9) | (dw << 4) | 3;
+	if (sim->config.tbe32_us) {
+		dw |= sim_sfdp_time(sim->config.tbe32_us, erase_units, 4, 5, &unit) << 11;
+		dw |= unit << 16;
+	}
+	if (sim->config.tbe64_us) {
+		dw |= sim_sfdp_time(sim->config.tbe64_us, erase_units, 4, 5, &unit) << 18;
+		dw |= unit << 23;
+	}
+	sim_set_dword(p + 9*4, dw);
+
+	// DWORD11 : y[WvOԁAy[WTCYA`bv 
+	dw = sim_sfdp_time(sim->config.tpp_us, pp_units, 2, 5, &unit);
+	dw = (unit << 13) | (dw << 8) | (8 << 4) | 3;
+	dw |= (0 << 18) | (0 << 14) | (0 << 23) | (0 << 19);			// oCgvO(1us) 
+	dw |= sim_sfdp_time(sim->config.tce_ms, ce_units, 4, 5, &unit) << 24;
+	dw |= unit << 29;
+	sim_set_dword(p + 10*4, dw);
+
+	// DWORD12-13 : TXyh(75h)/W[(7Ah)ATXyhԂtSUS(1usP)AԊutRS(64usP) 
+	if (sim->config.tsus_us) {
+		dw = (1 << 29) | (sim_sfdp_time(sim->config.tsus_us, sus_units, 1, 5, &unit) << 24);
+		dw |= (1 << 18) | (sim_sfdp_time(sim->config.tsus_us, sus_units, 1, 5, &unit) << 13);
+		dw |= sim_sfdp_time(sim->config.trs_us, rs_units, 1, 4, &unit) << 20;
+		dw |= sim_sfdp_time(sim->config.trs_us, rs_units, 1, 4, &unit) << 9;
+		dw |= 0xee;
+		sim_set_dword(p + 11*4, dw);
+		sim_set_dword(p + 12*4, (0x75 << 24) | (0x7a << 16) | (0x75 << 8) | (0x7a << 0));
+	} else {
+		sim_set_dword(p + 11*4, 0x80000000);
+		sim_set_dword(p + 12*4, 0x00000000);
+	}
+
+	// DWORD14 : Xe[^XWX^(05h)busy|[O 
+	sim_set_dword(p + 13*4, 0x80000000 | (1<<2));
+
+	// DWORD15 : QESR2 bit1A01h2oCg(QER=1) 
+	//           0-4-4[h̓[hrbgAxhŊJnAAxhȊOŏI 
+	sim_set_dword(p + 14*4, (1 << 20) | (1 << 18) | (1 << 14) | (1 << 9));
+
+	// DWORD16 : \tgEFAZbg(66h/99h) 
+	sim_set_dword(p + 15*4, (1 << 11));
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Flash device model                                                    */
+/*-----------------------------------------------------------------------*/
+
+static const SIM_OPINFO *sim_opinfo(
+	BYTE opcode
+)
+{
+	UINT i;
+
+	for(i=0 ; i<sizeof(sim_optable)/sizeof(SIM_OPINFO) ; i++) {
+		if (sim_optable[i].opcode == opcode) return &sim_optable[i];
+	}
+
+	return NULL;
+}
+
+static int sim_isbusy(
+	DEF_SPIDISK_SIM *sim
+)
+{
+	return (sim->time_ns < sim->busy_until_ns);
+}
+
+static void sim_setbusy(
+	DEF_SPIDISK_SIM *sim,
+	QWORD time_ns
+)
+{
+	sim->busy_until_ns = sim->time_ns + time_ns;
+	sim->busy_time_ns += time_ns;
+}
+
+// R}h̊Jn(R}hEAhXE_~[̎M) 
+static void sim_begin(
+	DEF_SPIDISK_SIM *sim,
+	const SIM_OPINFO *op,
+	BYTE opcode,
+	DWORD address,
+	BYTE addr_width,
+	BYTE data_width
+)
+{
+	sim->command_count++;
+	sim->opcode = opcode;
+	sim->optype = (op != NULL)? op->type : SIM_OP_NONE;
+	sim->address = address;
+	sim->data_count = 0;
+	sim->ignored = 0;
+
+	if (op == NULL) {
+		sim->ignored = 1;											// Ή̃R}h 
+		sim->error_count++;
+		return;
+	}
+
+	// }bv[h̓R}h𔭍słȂ 
+	if (sim->mapped) {
+		sim->ignored = 1;
+		sim->error_count++;
+		return;
+	}
+
+	// busy̓Xe[^XǂݏoATXyhƃZbgȊO󂯕tȂ 
+	if (sim_isbusy(sim) && !(op->type == SIM_OP_RDSR || op->type == SIM_OP_RDSR2 ||
+			op->type == SIM_OP_SUSPEND || op->type == SIM_OP_RSTEN || op->type == SIM_OP_RST)) {
+		sim->ignored = 1;
+		sim->error_count++;
+		return;
+	}
+
+	// TXyh̓vOEEXe[^XWX^݂󂯕tȂ 
+	if (sim->suspended && (op->type == SIM_OP_PROGRAM || op->type == SIM_OP_ERASE ||
+			op->type == SIM_OP_ERASE32 || op->type == SIM_OP_ERASE64 || op->type == SIM_OP_CHIPERASE ||
+			op->type == SIM_OP_WRSR || op->type == SIM_OP_WRSR2)) {
+		sim->ignored = 1;
+		sim->error_count++;
+		return;
+	}
+
+	// oXR}hƈvĂȂ 
+	if (addr_width != op->addr_width || data_width != op->data_width) {
+		sim->ignored = 1;
+		sim->error_count++;
+		return;
+	}
+
+	// ΉĂȂubN 
+	if ((op->type == SIM_OP_ERASE32 && sim->config.tbe32_us == 0) ||
+			(op->type == SIM_OP_ERASE64 && sim->config.tbe64_us == 0)) {
+		sim->ignored = 1;
+		sim->error_count++;
+		return;
+	}
+
+	// QEZbgĂȂԂł̃NbhR}h 
+	if ((op->addr_width == 4 || op->data_width == 4) && !(sim->status2 & SIM_STATUS2_QE)) {
+		sim->ignored = 1;
+		sim->error_count++;
+		return;
+	}
+
+	if (op->type != SIM_OP_RST) sim->reset_enable = 0;
+
+	// 3oCgAhXR}h͉16MoCgANZX 
+	if (op->addr_bytes == 3) sim->address &= 0xffffff;
+	sim->address %= sim->config.memsize;
+
+	switch (op->type) {
+		case SIM_OP_READ:
+			sim->read_opcode = opcode;
+			sim->read_addr_width = addr_width;
+			sim->read_data_width = data_width;
+			if (sim->suspended && sim->address - sim->busy_address < sim->busy_size) {
+				sim->error_count++;									// TXyh͈̔͂̓ǂݏo͕s 
+			}
+			break;
+
+		case SIM_OP_PROGRAM:
+			memset(sim->pagemask, 0, SPISIM_PAGE_SIZE);
+			break;
+
+		case SIM_OP_RDSR:
+		case SIM_OP_RDSR2:
+			sim->status_count++;
+			break;
+	}
+}
+
+// f[^tF[Y1oCg 
+static BYTE sim_data(
+	DEF_SPIDISK_SIM *sim,
+	BYTE send
+)
+{
+	BYTE res = 0xff;
+	UINT n;
+
+	if (sim->ignored) return 0xff;
+
+	switch (sim->optype) {
+		case SIM_OP_READ:
+			res = sim->mem[sim->address];
+			sim->address = (sim->address + 1) % sim->config.memsize;
+			sim->read_bytes[sim->read_data_width >> 1]++;
+			break;
+
+		case SIM_OP_SFDP:
+			res = sim->sfdp[sim->address % SPISIM_SFDP_SIZE];
+			sim->address++;
+			break;
+
+		case SIM_OP_PROGRAM:
+			n = (sim->address + sim->data_count) % SPISIM_PAGE_SIZE;	// y[WŃbvAEh 
+			sim->pagebuf[n] = send;
+			sim->pagemask[n] = 1;
+			break;
+
+		case SIM_OP_RDSR:
+			res = sim->status | (sim->wel ? SIM_STATUS_WEL : 0) | (sim_isbusy(sim) ? SIM_STATUS_WIP : 0);
+			break;
+
+		case SIM_OP_RDSR2:
+			res = sim->status2;
+			break;
+
+		case SIM_OP_WRSR:
+		case SIM_OP_WRSR2:
+			if (sim->data_count < 2) sim->regbuf[sim->data_count] = send;
+			break;
+
+		case SIM_OP_RDID:
+			if (sim->data_count < 3) res = (sim->config.jedec_id >> ((2 - sim->data_count) * 8))& 0xff;
+			break;
+	}
+	sim->data_count++;
+
+	return res;
+}
+
+// R}h̏I(`bvZNg̃lQ[g) 
+static void sim_end(
+	DEF_SPIDISK_SIM *sim
+)
+{
+	DWORD top;
+	UINT i,n;
+
+	if (sim->ignored) return;
+
+	switch (sim->optype) {
+		case SIM_OP_WREN:
+			sim->wel = 1;
+			break;
+
+		case SIM_OP_WRDI:
+			sim->wel = 0;
+			break;
+
+		case SIM_OP_PROGRAM:
+			if (!sim->wel || sim->data_count == 0) break;
+			top = sim->address & ~(SPISIM_PAGE_SIZE-1);
+			for(i=0 ; i<SPISIM_PAGE_SIZE ; i++) {
+				if (sim->pagemask[i]) sim->mem[top + i] &= sim->pagebuf[i];	// vO0ɂłȂ 
+			}
+			sim->wel = 0;
+			sim->program_count++;
+			sim->program_bytes += (sim->data_count < SPISIM_PAGE_SIZE)? sim->data_count : SPISIM_PAGE_SIZE;
+			sim_setbusy(sim, (QWORD)sim->config.tpp_us * 1000);
+			sim->busy_address = top;
+			sim->busy_size = SPISIM_PAGE_SIZE;
+			break;
+
+		case SIM_OP_ERASE:
+			if (!sim->wel) break;
+			memset(sim->mem + (sim->address & ~(SIM_ERASE_SIZE-1)), 0xff, SIM_ERASE_SIZE);
+			sim->wel = 0;
+			sim->erase_count++;
+			sim_setbusy(sim, (QWORD)sim->config.tse_us * 1000);
+			sim->busy_address = sim->address & ~(SIM_ERASE_SIZE-1);
+			sim->busy_size = SIM_ERASE_SIZE;
+			break;
+
+		case SIM_OP_ERASE32:
+		case SIM_OP_ERASE64:
+			if (!sim->wel) break;
+			n = (sim->optype == SIM_OP_ERASE32)? 32*1024 : 64*1024;
+			memset(sim->mem + (sim->address & ~(n-1)), 0xff, n);
+			sim->wel = 0;
+			sim->block_erase_count++;
+			sim_setbusy(sim, (QWORD)((sim->optype == SIM_OP_ERASE32)? sim->config.tbe32_us : sim->config.tbe64_us) * 1000);
+			sim->busy_address = sim->address & ~(n-1);
+			sim->busy_size = n;
+			break;
+
+		case SIM_OP_CHIPERASE:
+			if (!sim->wel) break;
+			memset(sim->mem, 0xff, sim->config.memsize);
+			sim->wel = 0;
+			sim->erase_count += sim->config.memsize / SIM_ERASE_SIZE;
+			sim_setbusy(sim, (QWORD)sim->config.tce_ms * 1000000);
+			sim->busy_size = 0;
+			break;
+
+		case SIM_OP_SUSPEND:
+			if (sim->config.tsus_us == 0) {
+				sim->error_count++;									// ΉĂȂTXyh 
+				break;
+			}
+			if (sim->suspended || !sim_isbusy(sim) || sim->busy_size == 0) break;	// 쒆łȂΖ 
+			if (sim->resume_ns && sim->time_ns - sim->resume_ns < (QWORD)sim->config.trs_us * 1000) {
+				sim->error_count++;									// W[ŏԊuoĂȂ 
+			}
+			sim->suspend_remain_ns = sim->busy_until_ns - sim->time_ns;
+			sim->busy_time_ns -= sim->suspend_remain_ns;
+			sim->busy_until_ns = sim->time_ns;
+			sim_setbusy(sim, (QWORD)sim->config.tsus_us * 1000);
+			sim->suspended = 1;
+			sim->suspend_count++;
+			break;
+
+		case SIM_OP_RESUME:
+			if (!sim->suspended) break;
+			sim->suspended = 0;
+			if (sim->busy_until_ns < sim->time_ns) sim->busy_until_ns = sim->time_ns;
+			sim->busy_until_ns += sim->suspend_remain_ns;
+			sim->busy_time_ns += sim->suspend_remain_ns;
+			sim->resume_ns = sim->time_ns;
+			break;
+
+		case SIM_OP_WRSR:
+			if (!sim->wel || sim->data_count == 0) break;
+			sim->status = sim->regbuf[0] & ~(SIM_STATUS_WIP | SIM_STATUS_WEL);
+			sim->status2 = (sim->data_count >= 2)? sim->regbuf[1] : 0;	// 1oCg݂SR2NA 
+			sim->wel = 0;
+			sim_setbusy(sim, (QWORD)sim->config.tw_us * 1000);
+			sim->busy_size = 0;
+			break;
+
+		case SIM_OP_WRSR2:
+			if (!sim->wel || sim->data_count == 0) break;
+			sim->status2 = sim->regbuf[0];
+			sim->wel = 0;
+			sim_setbusy(sim, (QWORD)sim->config.tw_us * 1000);
+			sim->busy_size = 0;
+			break;
+
+		case SIM_OP_RSTEN:
+			sim->reset_enable = 1;
+			break;
+
+		case SIM_OP_RST:
+			if (!sim->reset_enable) break;
+			sim->reset_enable = 0;
+			sim->wel = 0;
+			sim->suspended = 0;
+			sim->busy_until_ns = sim->time_ns + SIM_TRST_NS;		// ͒f 
+			break;
+	}
+}
+
+// oXԂi߂ 
+static void sim_clock(
+	DEF_SPIDISK_SIM *sim,
+	QWORD clocks,
+	QWORD overhead_ns
+)
+{
+	QWORD t = SIM_CLOCK_NS(sim, clocks);
+
+	sim->bus_time_ns += t;
+	sim->time_ns += t + overhead_ns;
+}
+
+// DMA]ĊR[obNĂ 
+static void sim_dma_finish(
+	DEF_SPIDISK_SIM *sim
+)
+{
+	if (!sim->dma_pending) return;
+
+	if (sim->time_ns < sim->dma_done_ns) sim->time_ns = sim->dma_done_ns;
+	sim->dma_pending = 0;
+	sim->dma_complete(sim->dma_arg, RES_OK);
+}
+
+// DMA]̃oXANZX̓vgRᔽ 
+static void sim_dma_conflict(
+	DEF_SPIDISK_SIM *sim
+)
+{
+	if (!sim->dma_pending) return;
+
+	sim->error_count++;
+	sim_dma_finish(sim);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* SPI-disk interface                                                    */
+/*-----------------------------------------------------------------------*/
+
+static void sim_select(
+	void *context,
+	BYTE assert
+)
+{
+	DEF_SPIDISK_SIM *sim = (DEF_SPIDISK_SIM *)context;
+
+	sim_dma_conflict(sim);
+
+	if (assert) {
+		if (!sim->cs) {
+			sim->cs = 1;
+			sim->count = 0;
+		}
+	} else {
+		if (sim->cs && sim->count > 0) {
+			if (sim->count < sim->header_len) sim->ignored = 1;	// wb_̓rŏI 
+			sim_end(sim);
+		}
+		sim->cs = 0;
+		sim->count = 0;
+		sim_clock(sim, 8, sim->config.xfer_overhead_ns);		// `bvZNg̍ŒlQ[g 
+	}
+}
+
+// 1oCg]ł̓oX1ƂĈ 
+static BYTE sim_transfer(
+	void *context,
+	BYTE send
+)
+{
+	DEF_SPIDISK_SIM *sim = (DEF_SPIDISK_SIM *)context;
+	const SIM_OPINFO *op;
+	BYTE res = 0xff;
+
+	sim_dma_conflict(sim);
+	sim->transfer_count++;
+	sim_clock(sim, 8, sim->config.xfer_overhead_ns);
+
+	if (!sim->cs) {
+		sim->cs = 1;
+		sim->count = 0;
+	}
+
+	if (sim->count == 0) {
+		if (sim->continuous) send = 0;								// R}hoCgAhXƂĉ߂ 
+		sim->opcode = send;
+		sim->address = 0;
+		sim->ignored = 0;
+		op = sim_opinfo(send);
+		sim->header_len = (op != NULL)? 1 + op->addr_bytes + (op->dummy_clocks * op->addr_width + 7) / 8 : 1;
+	} else if (sim->count < sim->header_len) {
+		op = sim_opinfo(sim->opcode);
+		if (sim->count <= op->addr_bytes) sim->address = (sim->address << 8) | send;
+	} else {
+		res = sim_data(sim, send);
+	}
+	sim->count++;
+
+	if (sim->count == sim->header_len) {
+		sim_begin(sim, sim_opinfo(sim->opcode), sim->opcode, sim->address, 1, 1);
+	}
+
+	return res;
+}
+
+// burst/dmãR}hs 
+static void sim_execute(
+	DEF_SPIDISK_SIM *sim,
+	const DEF_SPICOMMAND *cmd
+)
+{
+	const SIM_OPINFO *op;
+	const BYTE *p = cmd->txbuff;
+	BYTE *v = cmd->rxbuff;
+	BYTE opcode = cmd->opcode;
+	BYTE mode_bits = cmd->mode_bits;
+	BYTE res;
+	DWORD address, n;
+
+	if (cmd->no_opcode) {
+		if (!sim->continuous) {
+			if (cmd->address == 0 && cmd->mode_bits == 0) return;	// ׂĂ̐M0̏ꍇNOPɂȂ 
+			opcode = 0;												// AhX̐擪R}hƂĉ߂ 
+		} else {
+			opcode = sim->cont_opcode;
+			sim->continuous_count++;
+		}
+	} else if (sim->continuous) {
+		opcode = 0;													// R}hoCgAhXƂĉ߂ 
+	}
+
+	op = sim_opinfo(opcode);
+
+	address = cmd->address;
+
+	if (op != NULL && cmd->no_opcode && cmd->length == 0 && cmd->addr_bytes == op->addr_bytes + 1) {
+		address >>= 8;												// 3oCgAhX̘Aǂݏo[h4oCgꍇ 
+		mode_bits = cmd->address & 0xff;							// 4oCgڂ[hrbgɂȂ 
+	} else {
+		if (op != NULL && cmd->addr_bytes != op->addr_bytes) op = NULL;	// R}ȟ`vȂ 
+		if (op != NULL && cmd->dummy_clocks != op->dummy_clocks) {
+			if (!(cmd->no_opcode && cmd->length == 0 && cmd->dummy_clocks * cmd->addr_width >= 8)) op = NULL;
+		}															// 0̓ǂݏo̓[hNbN܂łŏIł 
+	}
+	sim_begin(sim, op, opcode, address, cmd->addr_width, cmd->data_width);
+
+	// [hrbgAxhŘAǂݏo[hɓ 
+	if (!sim->ignored && (opcode == 0xeb || opcode == 0xec)) {
+		sim->continuous = ((mode_bits & 0xf0) == 0xa0);
+		sim->cont_opcode = opcode;
+	}
+
+	for(n=cmd->length ; n>0 ; n--) {
+		res = sim_data(sim, (p != NULL)? *p++ : 0xff);
+		if (v != NULL) *v++ = res;
+	}
+
+	sim_end(sim);
+}
+
+// R}h̃NbN(`bvZNg̍ŒlQ[gԂ܂) 
+static QWORD sim_command_clocks(
+	const DEF_SPICOMMAND *cmd
+)
+{
+	return (cmd->no_opcode ? 0 : 8) + (cmd->addr_bytes * 8 / cmd->addr_width) + cmd->dummy_clocks +
+			((QWORD)cmd->length * 8 / cmd->data_width) + 8;
+}
+
+static DRESULT sim_burst(
+	void *context,
+	const DEF_SPICOMMAND *cmd
+)
+{
+	DEF_SPIDISK_SIM *sim = (DEF_SPIDISK_SIM *)context;
+
+	sim_dma_conflict(sim);
+	sim->burst_count++;
+	sim_clock(sim, sim_command_clocks(cmd) - 8, sim->config.burst_overhead_ns);
+	sim_execute(sim, cmd);
+	sim_clock(sim, 8, 0);											// `bvZNg̍ŒlQ[g 
+
+	return RES_OK;
+}
+
+// DMAGW̓zXg̃ZbgAbvԂ̌AoXNbN̎Ԃœ] 
+static DRESULT sim_dma(
+	void *context,
+	const DEF_SPICOMMAND *cmd,
+	void (*complete)(void *arg, DRESULT res),
+	void *arg
+)
+{
+	DEF_SPIDISK_SIM *sim = (DEF_SPIDISK_SIM *)context;
+	QWORD t;
+
+	sim_dma_conflict(sim);
+	sim->dma_count++;
+	sim_clock(sim, 0, sim->config.burst_overhead_ns);
+
+	// R}ȟʂ͓]̎_Ŕ 
+	t = SIM_CLOCK_NS(sim, sim_command_clocks(cmd));
+	sim->bus_time_ns += t;
+	sim->dma_done_ns = sim->time_ns + t;
+
+	sim->time_ns += t;
+	sim_execute(sim, cmd);
+	sim->time_ns -= t;
+
+	sim->dma_complete = complete;
+	sim->dma_arg = arg;
+	sim->dma_pending = 1;
+
+	return RES_OK;
+}
+
+// DMA]̊荞݂A^CAEg܂ő҂ 
+static void sim_wait(
+	void *context,
+	DWORD usec
+)
+{
+	DEF_SPIDISK_SIM *sim = (DEF_SPIDISK_SIM *)context;
+	QWORD t = (QWORD)usec * 1000;
+
+	if (sim->dma_pending && sim->dma_done_ns <= sim->time_ns + t) {
+		t = (sim->dma_done_ns > sim->time_ns)? sim->dma_done_ns - sim->time_ns : 0;
+	}
+	sim->time_ns += t;
+	sim->wait_time_ns += t;
+
+	if (sim->dma_pending && sim->time_ns >= sim->dma_done_ns) sim_dma_finish(sim);
+}
+
+static void sim_delay(
+	void *context,
+	DWORD usec
+)
+{
+	DEF_SPIDISK_SIM *sim = (DEF_SPIDISK_SIM *)context;
+
+	sim->time_ns += (QWORD)usec * 1000;
+	sim->wait_time_ns += (QWORD)usec * 1000;
+
+	if (sim->dma_pending && sim->time_ns >= sim->dma_done_ns) sim_dma_finish(sim);
+}
+
+// }bv[hł̓AĈ܂܌ 
+static const BYTE *sim_map(
+	void *context,
+	BYTE enable
+)
+{
+	DEF_SPIDISK_SIM *sim = (DEF_SPIDISK_SIM *)context;
+
+	sim_dma_conflict(sim);
+	sim_clock(sim, 0, sim->config.burst_overhead_ns);
+
+	if (!enable) {
+		sim->mapped = 0;
+		return NULL;
+	}
+
+	if (sim_isbusy(sim)) {
+		sim->error_count++;											// busy̓ACǂݏoȂ 
+		return NULL;
+	}
+
+	sim->mapped = 1;
+	sim->map_count++;
+
+	return sim->mem;
+}
+
+
+static const DEF_SPIDISK_IF spidisk_if_sim = {
+	sim_select,
+	sim_transfer,
+	sim_burst,
+	NULL,
+	sim_delay,
+	NULL,
+	NULL,
+	NULL,
+	NULL,
+	1
+};
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Open/Close simulator                                                  */
+/*-----------------------------------------------------------------------*/
+
+void spidisk_sim_config(
+	DEF_SPIDISK_SIMCONFIG *config,
+	DWORD memsize
+)
+{
+	config->memsize = memsize;
+	config->jedec_id = 0;
+	config->clock_hz = 50000000;
+	config->xfer_overhead_ns = 200;
+	config->burst_overhead_ns = 1000;
+	config->tpp_us = 400;
+	config->tse_us = 45000;
+	config->tbe32_us = 120000;
+	config->tbe64_us = 150000;
+	config->tce_ms = memsize / (1024*1024) * 2500;
+	config->tw_us = 10000;
+	config->tsus_us = 20;
+	config->trs_us = 64;
+	config->buswidth = 1;
+	config->mapped_read = 0;
+	config->dma = 0;
+}
+
+
+DRESULT spidisk_sim_open(
+	DEF_SPIDISK_SIM *sim,
+	const char *path,
+	const DEF_SPIDISK_SIMCONFIG *config
+)
+{
+	struct stat st;
+	DWORD oldsize;
+	UINT n;
+
+	memset(sim, 0, sizeof(DEF_SPIDISK_SIM));
+	sim->config = *config;
+	sim->fd = -1;
+
+	if (config->memsize < 2*1024*1024 || config->memsize > 256*1024*1024 ||
+			(config->memsize & (config->memsize - 1)) != 0) return RES_PARERR;
+	if (config->clock_hz == 0) return RES_PARERR;
+	if (!(config->buswidth == 1 || config->buswidth == 2 || config->buswidth == 4)) return RES_PARERR;
+
+	if (config->jedec_id == 0) {
+		for(n=0 ; (1UL << n) < config->memsize ; n++) {}
+		sim->config.jedec_id = 0xef4000 | n;
+	}
+
+	// C[Wt@C̃}bsO 
+	if (path != NULL) {
+		sim->fd = open(path, O_RDWR | O_CREAT, 0644);
+		if (sim->fd < 0) return RES_NOTRDY;
+
+		if (fstat(sim->fd, &st) < 0) goto error_exit;
+		oldsize = (st.st_size < config->memsize)? st.st_size : config->memsize;
+		if (st.st_size < config->memsize && ftruncate(sim->fd, config->memsize) < 0) goto error_exit;
+
+		sim->mem = mmap(NULL, config->memsize, PROT_READ | PROT_WRITE, MAP_SHARED, sim->fd, 0);
+		if (sim->mem == MAP_FAILED) goto error_exit;
+
+		memset(sim->mem + oldsize, 0xff, config->memsize - oldsize);	// V̈͏ 
+	} else {
+		sim->mem = mmap(NULL, config->memsize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if (sim->mem == MAP_FAILED) return RES_NOTRDY;
+
+		memset(sim->mem, 0xff, config->memsize);
+	}
+
+	sim_build_sfdp(sim);
+
+	sim->spi_if = spidisk_if_sim;
+	sim->spi_if.buswidth = config->buswidth;
+	if (config->mapped_read) sim->spi_if.map = sim_map;
+	if (config->dma) {
+		sim->spi_if.dma = sim_dma;
+		sim->spi_if.wait = sim_wait;
+	}
+
+	return RES_OK;
+
+error_exit:
+	close(sim->fd);
+	sim->fd = -1;
+	sim->mem = NULL;
+
+	return RES_NOTRDY;
+}
+
+
+void spidisk_sim_close(
+	DEF_SPIDISK_SIM *sim
+)
+{
+	if (sim->mem != NULL) {
+		if (sim->fd >= 0) msync(sim->mem, sim->config.memsize, MS_SYNC);
+		munmap(sim->mem, sim->config.memsize);
+	}
+	if (sim->fd >= 0) close(sim->fd);
+
+	sim->mem = NULL;
+	sim->fd = -1;
+}
+
+
+void spidisk_sim_clear(
+	DEF_SPIDISK_SIM *sim
+)
+{
+	sim->busy_until_ns = (sim->busy_until_ns > sim->time_ns)? sim->busy_until_ns - sim->time_ns : 0;
+	sim->time_ns = 0;
+	sim->resume_ns = 0;
+	sim->bus_time_ns = 0;
+	sim->busy_time_ns = 0;
+	sim->wait_time_ns = 0;
+
+	sim->command_count = 0;
+	sim->transfer_count = 0;
+	sim->burst_count = 0;
+	sim->status_count = 0;
+	sim->program_count = 0;
+	sim->erase_count = 0;
+	sim->block_erase_count = 0;
+	sim->map_count = 0;
+	sim->dma_count = 0;
+	sim->continuous_count = 0;
+	sim->suspend_count = 0;
+	sim->error_count = 0;
+	sim->read_bytes[0] = 0;
+	sim->read_bytes[1] = 0;
+	sim->read_bytes[2] = 0;
+	sim->program_bytes = 0;
+}
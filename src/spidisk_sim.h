@@ -0,0 +1,176 @@
+// ------------------------------------------------------------------- //
+//  PERIDOT-NGS SPI flash Filesystem (SPI flash simulator)             //
+// ------------------------------------------------------------------- //
+//
+//  ver 0.91
+//		2017/03/11	s.osafune@gmail.com
+//
+// ******************************************************************* //
+//  The MIT License (MIT)
+//  Copyright (c) 2017 J-7SYSTEM WORKS LIMITED.
+//
+//  Permission is hereby granted, free of charge, to any person
+//  obtaining a copy of this software and associated documentation
+//  files (the "Software"), to deal in the Software without restriction,
+//  including without limitation the rights to use, copy, modify, merge,
+//  publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be
+//  included in all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+//  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+//  NONINFRINGEMENT.
+//  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+//  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+//  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// ******************************************************************* //
+
+
+
+#ifndef _SPIDISK_SIM_DEFINED
+#define _SPIDISK_SIM_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "spidisk.h"
+
+
+/*-----------------------------------------------------------------------*/
+/* Configuration                                                         */
+/*-----------------------------------------------------------------------*/
+
+#define SPISIM_SFDP_SIZE		(256)	// SFDP̈̃TCY(oCg) 
+#define SPISIM_PAGE_SIZE		(256)	// vOy[WTCY(oCg) 
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Function prototype                                                    */
+/*-----------------------------------------------------------------------*/
+
+typedef struct {
+	DWORD memsize;			// foCXe(oCg) 2MoCg(16Mbit)`256MoCg(2Gbit)2ׂ̂ 
+	DWORD jedec_id;			// JEDEC ID(0̏ꍇ͗eʂ琶) 
+	DWORD clock_hz;			// SPINbNg(Hz) 
+	DWORD xfer_overhead_ns;	// transfer 1񂠂̃zXgI[o[wbh(ns) 
+	DWORD burst_overhead_ns;	// burst 1񂠂̃zXgI[o[wbh(ns) 
+	DWORD tpp_us;			// y[WvO tPP (typ, us) 
+	DWORD tse_us;			// 4koCgZN^ tSE (typ, us) 
+	DWORD tbe32_us;			// 32koCgubN tBE1 (typ, us, 0=52hɑΉȂ) 
+	DWORD tbe64_us;			// 64koCgubN tBE2 (typ, us, 0=D8hɑΉȂ) 
+	DWORD tce_ms;			// `bv tCE (typ, ms) 
+	DWORD tw_us;			// Xe[^XWX^ݎ tW (us) 
+	DWORD tsus_us;			// TXyh tSUS (max, us, 0=TXyhɑΉȂ) 
+	DWORD trs_us;			// W[玟̃TXyh܂ł̍ŏԊu tRS (us) 
+	BYTE buswidth;			// SPI}X^̃f[^̐(1/2/4) 
+	BYTE mapped_read;		// }bvǂݏo : 1=Ή / 0=Ȃ 
+	BYTE dma;				// DMAGW : 1=g / 0=gȂ 
+} DEF_SPIDISK_SIMCONFIG;
+
+
+typedef struct {
+	DEF_SPIDISK_IF spi_if;	// C^[tF[Xe[u(spidisk_registerɓn) 
+	DEF_SPIDISK_SIMCONFIG config;
+	BYTE *mem;				// C[Wt@C̃}bsO 
+	int fd;					// C[Wt@C̃t@CfBXNv^ 
+	BYTE sfdp[SPISIM_SFDP_SIZE];
+
+	/* foCX̏ */
+	BYTE status;			// Xe[^XWX^1(WIP/WEL) 
+	BYTE status2;			// Xe[^XWX^2 
+	BYTE wel;				// ݃Cl[ub` 
+	BYTE reset_enable;		// ZbgCl[u 
+	BYTE mapped;			// }bv[h 
+	BYTE continuous;		// Aǂݏo[h(0-4-4) 
+	BYTE cont_opcode;		// Aǂݏo[hɓR}h 
+
+	/* DMAGW̏ */
+	BYTE dma_pending;		// DMA] 
+	QWORD dma_done_ns;		// DMA]̊ 
+	void (*dma_complete)(void *arg, DRESULT res);
+	void *dma_arg;
+	QWORD busy_until_ns;	// ̊ 
+	DWORD busy_address;		// s̃vOE̐擪AhX 
+	DWORD busy_size;		// s̃vOẼTCY(0=TXyhłȂ) 
+	BYTE suspended;			// vOETXyhĂ 
+	QWORD suspend_remain_ns;	// TXyh̎c莞 
+	QWORD resume_ns;		// ŌɃW[ 
+
+	/* R}h̏ */
+	BYTE cs;				// `bvZNg 
+	BYTE opcode;
+	BYTE optype;
+	BYTE ignored;			// R}hꂽ 
+	DWORD count;			// `bvZNg̃AT[g]oCg 
+	DWORD header_len;		// R}h{AhX{_~[̃oCg 
+	DWORD address;
+	DWORD data_count;		// f[^tF[ỸoCg 
+	BYTE pagebuf[SPISIM_PAGE_SIZE];
+	BYTE pagemask[SPISIM_PAGE_SIZE];
+	BYTE regbuf[2];
+
+	/* V~[V(ns) */
+	QWORD time_ns;			// oߎ 
+	QWORD bus_time_ns;		// SPIoX̃NbN 
+	QWORD busy_time_ns;		// vOEbusy 
+	QWORD wait_time_ns;		// zXgԑ҂ 
+
+	/* v */
+	DWORD command_count;	// sꂽR}h 
+	DWORD transfer_count;	// transfeřĂяo 
+	DWORD burst_count;		// bursťĂяo 
+	DWORD status_count;		// Xe[^Xǂݏo 
+	DWORD program_count;	// y[WvO 
+	DWORD erase_count;		// ZN^ 
+	DWORD block_erase_count;	// ubN 
+	DWORD map_count;		// }bv[hւ̐؂ւ 
+	DWORD dma_count;		// DMA]̉ 
+	DWORD continuous_count;	// R}hȗǂݏỏ 
+	DWORD suspend_count;	// TXyh̉ 
+	DWORD error_count;		// vgRᔽ(busỹR}hAoXsvȂ) 
+	QWORD read_bytes[3];	// ǂݏooCg(f[^1/2/4) 
+	QWORD program_bytes;	// vOoCg 
+	BYTE read_opcode;		// ŌɎgꂽǂݏoR}h 
+	BYTE read_addr_width;	// ŌɎgꂽǂݏõAhX 
+	BYTE read_data_width;	// ŌɎgꂽǂݏõf[^ 
+} DEF_SPIDISK_SIM;
+
+
+// WIȃp[^ݒ肷 
+void spidisk_sim_config(
+	DEF_SPIDISK_SIMCONFIG *config,
+	DWORD memsize			// foCXe(oCg) 
+);
+
+// V~[^̃I[v(pathNULL̏ꍇ̓t@CgȂ) 
+DRESULT spidisk_sim_open(
+	DEF_SPIDISK_SIM *sim,
+	const char *path,		// C[Wt@C 
+	const DEF_SPIDISK_SIMCONFIG *config
+);
+
+// V~[^̃N[Y 
+void spidisk_sim_close(
+	DEF_SPIDISK_SIM *sim
+);
+
+// V~[VԂƓṽNA 
+void spidisk_sim_clear(
+	DEF_SPIDISK_SIM *sim
+);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
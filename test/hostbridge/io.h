@@ -0,0 +1,15 @@
+// zXgspidisk_hostbridge.crh邽߂io.h(eXgp) 
+// WX^ANZXspidisk_testhost.c̃WX^fŃV~[^ɓn 
+
+#ifndef _TESTHOST_IO_H
+#define _TESTHOST_IO_H
+
+#include "integer.h"
+
+void testhost_iowr(DWORD base, int reg, DWORD data);
+DWORD testhost_iord(DWORD base, int reg);
+
+#define IOWR(_base, _reg, _data)	testhost_iowr((_base), (_reg), (_data))
+#define IORD(_base, _reg)			testhost_iord((_base), (_reg))
+
+#endif
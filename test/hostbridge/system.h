@@ -0,0 +1,8 @@
+// zXgspidisk_hostbridge.crh邽߂system.h(eXgp) 
+
+#ifndef _TESTHOST_SYSTEM_H
+#define _TESTHOST_SYSTEM_H
+
+#define PERIDOT_HOSTBRIDGE_BASE		(0)
+
+#endif
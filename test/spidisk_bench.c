@@ -0,0 +1,524 @@
+// ------------------------------------------------------------------- //
+//  PERIDOT-NGS SPI flash Filesystem (benchmark)                       //
+// ------------------------------------------------------------------- //
+//
+//  ver 0.91
+//		2017/03/11	s.osafune@gmail.com
+//
+// ******************************************************************* //
+//  The MIT License (MIT)
+//  Copyright (c) 2017 J-7SYSTEM WORKS LIMITED.
+//
+//  Permission is hereby granted, free of charge, to any person
+//  obtaining a copy of this software and associated documentation
+//  files (the "Software"), to deal in the Software without restriction,
+//  including without limitation the rights to use, copy, modify, merge,
+//  publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be
+//  included in all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+//  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+//  NONINFRINGEMENT.
+//  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+//  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+//  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// ******************************************************************* //
+
+// V~[^FatFs̓T^IȏsAV~[VԂƃoX̓v\ 
+//
+//  spidisk_bench [-m Mbit] [-w 1|2|4] [-d] [-r] [-b] [-l] [-t ] 
+//    -m : foCXe(Mbit, l16) 
+//    -w : SPI}X^̃f[^̐(l1) 
+//    -d : DMAGWg 
+//    -r : }bvǂݏog 
+//    -b : spidisk_hostbridge.c̃WX^foR(oX1) 
+//    -l : O\̃{[쐬 
+//    -t : ڂ1s(fs/sector/read/rewrite/trim/pool/log/append/wear) 
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "ff.h"
+#include "diskio.h"
+#include "spidisk.h"
+#include "spidisk_sim.h"
+#include "spidisk_testhost.h"
+
+
+/*-----------------------------------------------------------------------*/
+/* Define a macro                                                        */
+/*-----------------------------------------------------------------------*/
+
+#define BENCH_SECTOR_SIZE		(4096)		// ZN^TCY 
+#define BENCH_FILE_SIZE			(512*1024)	// ǂݏt@C̃TCY 
+#define BENCH_CHUNK_SIZE		(64*1024)	// f_readEf_write1̃TCY 
+#define BENCH_SECTOR_COUNT		(64)		// 1ZN^ǂݏoZN^ 
+
+static FATFS fs;
+static BYTE bench_mode = SPIDISK_FORMAT_STATIC;
+static const char *bench_item = NULL;
+static BYTE chunk[BENCH_CHUNK_SIZE];
+static BYTE sec[BENCH_SECTOR_SIZE];
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Helper                                                                */
+/*-----------------------------------------------------------------------*/
+
+// ڂs邩ǂ 
+static int bench_enabled(
+	const char *name
+)
+{
+	return bench_item == NULL || strcmp(bench_item, name) == 0;
+}
+
+// vNA(݂͐ɊĂ) 
+static void bench_clear(void)
+{
+	disk_ioctl(0, CTRL_SYNC, NULL);
+	disk_ioctl(0, SPIDISK_CLEAR_STAT, NULL);
+	testhost_clear();
+}
+
+// hCo̓v\ 
+static void bench_stat(void)
+{
+	DEF_SPIDISKSTAT st;
+
+	disk_ioctl(0, SPIDISK_GET_STAT, &st);
+	printf("             write=%lu erase=%lu skip=%lu program=%lu verify=%lu elide=%lu pool=%lu/%lu",
+		st.write_count, st.erase_count, st.erase_skip_count, st.program_count, st.verify_count,
+		st.elide_count, st.pool_hit_count, st.pool_miss_count);
+	if (st.lba_write_count) printf(" lba_write=%lu", st.lba_write_count);
+	if (st.ftl_write_count) printf(" ftl=%lu journal=%lu", st.ftl_write_count, st.journal_count);
+	printf("\n");
+}
+
+// t@Cp^[ŏ 
+static FRESULT bench_writefile(
+	const char *path,
+	DWORD size,
+	BYTE seed
+)
+{
+	FIL fil;
+	FRESULT res;
+	DWORD i, n;
+	UINT bw;
+
+	res = f_open(&fil, path, FA_WRITE | FA_CREATE_ALWAYS);
+	if (res != FR_OK) return res;
+
+	for(n=0 ; n<size && res == FR_OK ; n+=BENCH_CHUNK_SIZE) {
+		for(i=0 ; i<BENCH_CHUNK_SIZE ; i++) chunk[i] = (BYTE)((n + i) * 7 + seed);
+		res = f_write(&fil, chunk, BENCH_CHUNK_SIZE, &bw);
+	}
+	f_close(&fil);
+
+	return res;
+}
+
+// t@Cǂݏoăp^[Ɣׂ(v1) 
+static int bench_readfile(
+	const char *path,
+	DWORD size,
+	BYTE seed
+)
+{
+	FIL fil;
+	DWORD i, n;
+	UINT br;
+	int ok = 1;
+
+	if (f_open(&fil, path, FA_READ) != FR_OK) return 0;
+
+	for(n=0 ; n<size && ok ; n+=BENCH_CHUNK_SIZE) {
+		if (f_read(&fil, chunk, BENCH_CHUNK_SIZE, &br) != FR_OK || br != BENCH_CHUNK_SIZE) ok = 0;
+		for(i=0 ; ok && i<BENCH_CHUNK_SIZE ; i++) {
+			if (chunk[i] != (BYTE)((n + i) * 7 + seed)) ok = 0;
+		}
+	}
+	f_close(&fil);
+
+	return ok;
+}
+
+// t@C̐擪LBAZN^ 
+static DWORD bench_filelba(
+	FIL *fil
+)
+{
+	return fs.database + (fil->obj.sclust - 2) * fs.csize;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Benchmark items                                                       */
+/*-----------------------------------------------------------------------*/
+
+// [xtH[}bgEf_mkfsE200s̃t@C̍쐬 
+static int bench_fs(void)
+{
+	static BYTE work[_MAX_SS];
+	char line[32];
+	FIL fil;
+	UINT bw;
+	int i, n;
+
+	testhost_clear();
+	if (spidisk_format(0, 0, bench_mode) != RES_OK) return 0;
+	if (f_mkfs("", FM_ANY, 0, work, sizeof(work)) != FR_OK) return 0;
+	if (f_mount(&fs, "", 1) != FR_OK) return 0;
+
+	if (f_open(&fil, "line.txt", FA_WRITE | FA_CREATE_ALWAYS) != FR_OK) return 0;
+	for(i=0 ; i<200 ; i++) {
+		n = sprintf(line, "line %d hello\n", i);
+		f_write(&fil, line, n, &bw);
+	}
+	f_close(&fil);
+
+	if (bench_enabled("fs")) {
+		testhost_report("fs");
+		if (testhost_regaccess) printf("             register access=%lu\n", testhost_regaccess);
+	}
+
+	return 1;
+}
+
+// 1ZN^disk_readāA1ZN^̃R}hE]֐̌ĂяoEWX^ANZX̐\ 
+// (V~[^̃C^[tF[X̓o[Xg]A-b1oCg]̃G~[VŃWX^oR) 
+static void bench_sector(void)
+{
+	DEF_SPIDISK_SIM *sim = &testhost_sim;
+	DWORD n;
+
+	bench_clear();
+	for(n=0 ; n<BENCH_SECTOR_COUNT ; n++) {
+		disk_read(0, sec, n, 1);
+	}
+	testhost_report("sector");
+	printf("             per sector: time=%.3fms cmd=%.1f transfer=%.1f burst=%.1f register access=%.1f\n",
+		sim->time_ns / 1e6 / BENCH_SECTOR_COUNT, (double)sim->command_count / BENCH_SECTOR_COUNT,
+		(double)sim->transfer_count / BENCH_SECTOR_COUNT, (double)sim->burst_count / BENCH_SECTOR_COUNT,
+		(double)testhost_regaccess / BENCH_SECTOR_COUNT);
+}
+
+// 512kB̃t@C64kBPʂœǂݏoE16ZN^Pʂdisk_read 
+static void bench_read(void)
+{
+	DWORD lba, n;
+	FIL fil;
+	int ok;
+
+	bench_writefile("read.bin", BENCH_FILE_SIZE, 1);
+	f_open(&fil, "read.bin", FA_READ);
+	lba = bench_filelba(&fil);
+	f_close(&fil);
+
+	bench_clear();
+	ok = bench_readfile("read.bin", BENCH_FILE_SIZE, 1);
+	testhost_report(ok ? "read" : "read NG");
+	if (testhost_regaccess) printf("             register access=%lu (%.2f/byte)\n", testhost_regaccess, (double)testhost_regaccess / BENCH_FILE_SIZE);
+
+	bench_clear();
+	for(n=0 ; n<BENCH_FILE_SIZE / BENCH_SECTOR_SIZE ; n+=16) {
+		disk_read(0, chunk, lba + n, 16);
+	}
+	testhost_report("disk_read");
+}
+
+// 512kB̃t@Cxt@C@Ƃɏ 
+static void bench_rewrite(void)
+{
+	static const char *name[] = {"rewrite full", "rewrite crc", "rewrite smpl", "rewrite none"};
+	DEF_SPIVERIFY verify, save;
+	BYTE policy;
+
+	disk_ioctl(0, SPIDISK_GET_VERIFY, &save);
+	bench_writefile("rewrite.bin", BENCH_FILE_SIZE, 2);
+
+	for(policy=SPIDISK_VERIFY_FULL ; policy<=SPIDISK_VERIFY_NONE ; policy++) {
+		verify.policy = policy;
+		verify.interval = SPI_VERIFY_INTERVAL;
+		disk_ioctl(0, SPIDISK_SET_VERIFY, &verify);
+
+		bench_clear();
+		bench_writefile("rewrite.bin", BENCH_FILE_SIZE, 3 + policy);
+		disk_ioctl(0, CTRL_SYNC, NULL);
+		testhost_report(name[policy]);
+		bench_stat();
+	}
+	disk_ioctl(0, SPIDISK_SET_VERIFY, &save);
+
+	// ȅ 
+	bench_clear();
+	bench_writefile("rewrite.bin", BENCH_FILE_SIZE, 3 + SPIDISK_VERIFY_NONE);
+	testhost_report("rewrite same");
+	bench_stat();
+}
+
+#if _USE_TRIM
+// 1ZN^CTRL_TRIMŏA̒ɃfBNgǂݏo 
+static void bench_trim(void)
+{
+	DWORD lba, range[2], n;
+	QWORD t, t0, tmax, tsum;
+	FIL fil;
+
+	bench_writefile("trim.bin", 64 * BENCH_SECTOR_SIZE, 4);
+	f_open(&fil, "trim.bin", FA_READ);
+	lba = bench_filelba(&fil);
+	f_close(&fil);
+
+	bench_clear();
+	tmax = tsum = 0;
+	for(n=0 ; n<64 ; n++) {
+		range[0] = range[1] = lba + n;
+		disk_ioctl(0, CTRL_TRIM, range);
+ #if SPI_ERASE_POOL > 0
+		range[0] = 1;
+		disk_ioctl(0, SPIDISK_CTRL_IDLE, range);
+ #endif
+
+		t0 = testhost_time();
+		disk_read(0, sec, fs.dirbase, 1);
+		t = testhost_time() - t0;
+		tsum += t;
+		if (t > tmax) tmax = t;
+	}
+	f_unlink("trim.bin");
+	testhost_report("trim");
+	printf("             read after erase: avg=%.3fms max=%.3fms\n", tsum / 64 / 1e6, tmax / 1e6);
+}
+#endif
+
+#if _USE_TRIM && SPI_ERASE_POOL > 0
+// 폜t@C̃ZN^AChɏĂÃt@Cŏȗ 
+static void bench_pool(void)
+{
+	DWORD range[2], idle;
+	FIL fil;
+
+	bench_writefile("pool.bin", 256 * 1024, 5);
+	f_open(&fil, "pool.bin", FA_READ);
+	range[0] = bench_filelba(&fil);
+	range[1] = range[0] + 256 * 1024 / BENCH_SECTOR_SIZE - 1;
+	f_close(&fil);
+	f_unlink("pool.bin");
+	disk_ioctl(0, CTRL_TRIM, range);
+
+	bench_clear();
+	idle = 0;
+	disk_ioctl(0, SPIDISK_CTRL_IDLE, &idle);
+	testhost_report("pool idle");
+
+	bench_clear();
+	bench_writefile("pool.bin", 256 * 1024, 6);
+	testhost_report("pool write");
+	bench_stat();
+}
+#endif
+
+// 40oCg̃R[h2000ǋLA16R[hƂf_sync(wb_̏EȂ) 
+static void bench_log(void)
+{
+	char rec[64], head[16];
+	FSIZE_t end;
+	FIL fil;
+	UINT bw;
+	int pass, r, n;
+
+	for(pass=0 ; pass<2 ; pass++) {
+		bench_clear();
+		f_open(&fil, pass ? "log1.txt" : "log0.txt", FA_WRITE | FA_CREATE_ALWAYS);
+		for(r=0 ; r<2000 ; r++) {
+			n = sprintf(rec, "%06d,sensor=%08x,value=%d\n", r, r * 2654435761u, r % 977);
+			f_write(&fil, rec, n, &bw);
+			if (pass) {
+				end = f_tell(&fil);
+				sprintf(head, "%06d", r);
+				f_lseek(&fil, 0);
+				f_write(&fil, head, 6, &bw);
+				f_lseek(&fil, end);
+			}
+			if ((r % 16) == 15) f_sync(&fil);
+		}
+		f_close(&fil);
+		testhost_report(pass ? "log header" : "log");
+		bench_stat();
+	}
+}
+
+// 1R[hƂf_syncǋLƁA1ZN^ւ32oCgE1y[W̒ǋL 
+static void bench_append(void)
+{
+	char rec[64];
+	QWORD t, t0, tmax, tsum;
+	DWORD lba;
+	FIL fil;
+	UINT bw;
+	int r, n;
+
+	bench_clear();
+	tmax = tsum = 0;
+	f_open(&fil, "append.log", FA_WRITE | FA_CREATE_ALWAYS);
+	for(r=0 ; r<500 ; r++) {
+		n = sprintf(rec, "%06d,t=%08x,v=%d\n", r, r * 2654435761u, r % 977);
+		t0 = testhost_time();
+		f_write(&fil, rec, n, &bw);
+		f_sync(&fil);
+		t = testhost_time() - t0;
+		tsum += t;
+		if (t > tmax) tmax = t;
+	}
+	lba = bench_filelba(&fil);
+	f_close(&fil);
+	testhost_report("append");
+	printf("             f_sync per record: avg=%.3fms max=%.3fms\n", tsum / 500 / 1e6, tmax / 1e6);
+	bench_stat();
+
+	// t@Č̏ς݂̃ZN^32oCgǋL 
+	memset(sec, 0xff, BENCH_SECTOR_SIZE);
+	bench_clear();
+	tmax = tsum = 0;
+	for(r=0 ; r<BENCH_SECTOR_SIZE/32 ; r++) {
+		memset(sec + r * 32, 'a' + (r % 26), 32);
+		t0 = testhost_time();
+		disk_write(0, sec, lba + 20, 1);
+		disk_ioctl(0, CTRL_SYNC, NULL);
+		t = testhost_time() - t0;
+		tsum += t;
+		if (t > tmax) tmax = t;
+	}
+	testhost_report("append 32B");
+	printf("             disk_write per 32 bytes: avg=%.3fms max=%.3fms\n", tsum / (BENCH_SECTOR_SIZE/32) / 1e6, tmax / 1e6);
+	bench_stat();
+
+	// ς݂̃ZN^1y[W(256oCg)ǋL(ςy[W͏ɏς) 
+	memset(sec, 0xff, BENCH_SECTOR_SIZE);
+	bench_clear();
+	tmax = tsum = 0;
+	for(r=0 ; r<BENCH_SECTOR_SIZE/256 ; r++) {
+		memset(sec + r * 256, 'A' + (r % 26), 256);
+		t0 = testhost_time();
+		disk_write(0, sec, lba + 21, 1);
+		disk_ioctl(0, CTRL_SYNC, NULL);
+		t = testhost_time() - t0;
+		tsum += t;
+		if (t > tmax) tmax = t;
+	}
+	testhost_report("append page");
+	printf("             disk_write per page: avg=%.3fms max=%.3fms\n", tsum / (BENCH_SECTOR_SIZE/256) / 1e6, tmax / 1e6);
+	bench_stat();
+}
+
+#if _USE_SPI_LOGFTL && _USE_SPI_SATCACHE
+// O\̃{[7ZN^3000񏑂ASPIDISK_CTRL_IDLE(2)Ă 
+static void bench_wear(void)
+{
+	DEF_SPIDISKWEAR wear;
+	DWORD lba, budget;
+	QWORD t, t0, tmax;
+	int k;
+
+	lba = fs.database + 40;
+	bench_clear();
+	tmax = 0;
+	for(k=0 ; k<3000 ; k++) {
+		memset(sec, (k & 1) ? 0x55 : 0xaa, BENCH_SECTOR_SIZE);
+		sec[0] = k;
+		sec[1] = k >> 8;
+		disk_write(0, sec, lba + (k % 7), 1);
+
+		budget = 2;
+		t0 = testhost_time();
+		disk_ioctl(0, SPIDISK_CTRL_IDLE, &budget);
+		t = testhost_time() - t0;
+		if (t > tmax) tmax = t;
+	}
+	disk_ioctl(0, SPIDISK_GET_WEAR, &wear);
+	testhost_report("wear");
+	printf("             erase count min=%u max=%u, idle max=%.3fms\n", wear.min_count, wear.max_count, tmax / 1e6);
+	bench_stat();
+}
+#endif
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Main                                                                  */
+/*-----------------------------------------------------------------------*/
+
+int main(
+	int argc,
+	char *argv[]
+)
+{
+	DEF_SPIDISK_SIMCONFIG config;
+	DWORD mbit = 16;
+	BYTE transport = TESTHOST_IF_SIM;
+	int opt;
+
+	spidisk_sim_config(&config, mbit * 1024 * 1024 / 8);
+
+	while((opt = getopt(argc, argv, "m:w:drblt:")) != -1) {
+		switch(opt) {
+		case 'm' : mbit = atoi(optarg); break;
+		case 'w' : config.buswidth = atoi(optarg); break;
+		case 'd' : config.dma = 1; break;
+		case 'r' : config.mapped_read = 1; break;
+		case 'b' : transport = TESTHOST_IF_HOSTBRIDGE; break;
+		case 'l' : bench_mode = SPIDISK_FORMAT_LOG; break;
+		case 't' : bench_item = optarg; break;
+		default :
+			fprintf(stderr, "usage: %s [-m Mbit] [-w 1|2|4] [-d] [-r] [-b] [-l] [-t item]\n", argv[0]);
+			return 2;
+		}
+	}
+	config.memsize = mbit * 1024 * 1024 / 8;
+	config.tce_ms = config.memsize / (1024*1024) * 2500;
+
+	if (testhost_open(&config, NULL, transport) != RES_OK) {
+		fprintf(stderr, "simulator open error\n");
+		return 1;
+	}
+	printf("%luMbit x%u%s%s%s %s volume\n", mbit, config.buswidth, config.dma ? " dma" : "", config.mapped_read ? " mapped" : "",
+		transport == TESTHOST_IF_HOSTBRIDGE ? " hostbridge" : "", bench_mode == SPIDISK_FORMAT_LOG ? "log" : "static");
+
+	if (!bench_fs()) {
+		printf("format error\n");
+		testhost_close();
+		return 1;
+	}
+	if (bench_enabled("sector")) bench_sector();
+	if (bench_enabled("read")) bench_read();
+	if (bench_enabled("rewrite")) bench_rewrite();
+#if _USE_TRIM
+	if (bench_enabled("trim")) bench_trim();
+#endif
+#if _USE_TRIM && SPI_ERASE_POOL > 0
+	if (bench_enabled("pool")) bench_pool();
+#endif
+	if (bench_enabled("log")) bench_log();
+	if (bench_enabled("append")) bench_append();
+#if _USE_SPI_LOGFTL && _USE_SPI_SATCACHE
+	if (bench_enabled("wear") && bench_mode == SPIDISK_FORMAT_LOG) bench_wear();
+#endif
+
+	f_mount(NULL, "", 0);
+	testhost_close();
+
+	return 0;
+}
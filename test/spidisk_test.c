@@ -0,0 +1,718 @@
+// ------------------------------------------------------------------- //
+//  PERIDOT-NGS SPI flash Filesystem (test program)                    //
+// ------------------------------------------------------------------- //
+//
+//  ver 0.91
+//		2017/03/11	s.osafune@gmail.com
+//
+// ******************************************************************* //
+//  The MIT License (MIT)
+//  Copyright (c) 2017 J-7SYSTEM WORKS LIMITED.
+//
+//  Permission is hereby granted, free of charge, to any person
+//  obtaining a copy of this software and associated documentation
+//  files (the "Software"), to deal in the Software without restriction,
+//  including without limitation the rights to use, copy, modify, merge,
+//  publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be
+//  included in all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+//  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+//  NONINFRINGEMENT.
+//  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+//  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+//  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// ******************************************************************* //
+
+// V~[^ŃhCő@\ƏQ̓mF 
+// seXg̐IR[hŕԂ 
+
+
+#include <stdio.h>
+#include <string.h>
+#include "ff.h"
+#include "diskio.h"
+#include "spidisk.h"
+#include "spidisk_sim.h"
+#include "spidisk_testhost.h"
+
+
+/*-----------------------------------------------------------------------*/
+/* Define a macro                                                        */
+/*-----------------------------------------------------------------------*/
+
+#define TEST_MBIT				(16)		// V~[^̗e(Mbit) 
+#define TEST_SECTOR_SIZE		(4096)		// ZN^TCY(TCY) 
+#define TEST_PROGRAM_ADDRESS(_s)	(spidisk->top_address + (_s) * TEST_SECTOR_SIZE)
+
+extern DEF_SPIDISK *spidisk;
+
+static BYTE sec[TEST_SECTOR_SIZE];
+static BYTE chk[TEST_SECTOR_SIZE];
+static int test_failed;
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Test helper                                                           */
+/*-----------------------------------------------------------------------*/
+
+// eXǧʂ\ 
+static int test_result(
+	const char *name,
+	int ok,
+	const char *detail
+)
+{
+	printf("%-20s %s  %s\n", name, ok ? "ok" : "NG", detail);
+	if (!ok) test_failed++;
+
+	return ok;
+}
+
+// VV~[^Ń{[쐬ă}Eg 
+static int test_open(
+	DWORD mbit,
+	WORD rsv_count,
+	BYTE mode
+)
+{
+	DEF_SPIDISK_SIMCONFIG config;
+
+	spidisk_sim_config(&config, mbit * 1024 * 1024 / 8);
+	if (testhost_open(&config, NULL, TESTHOST_IF_SIM) != RES_OK) return 0;
+	if (spidisk_format(0, rsv_count, mode) != RES_OK) return 0;
+
+	spidisk = NULL;
+	if (disk_initialize(0) != 0) return 0;
+
+	return disk_ioctl(0, SPIDISK_CLEAR_STAT, NULL) == RES_OK;
+}
+
+// {[ǂݒ(d̍ē) 
+static int test_remount(void)
+{
+	spidisk = NULL;
+	return disk_initialize(0) == 0;
+}
+
+// LBAZN^valueCTRL_SYNC 
+static DRESULT test_write(
+	DWORD lba,
+	BYTE value
+)
+{
+	memset(sec, value, TEST_SECTOR_SIZE);
+	if (disk_write(0, sec, lba, 1) != RES_OK) return RES_ERROR;
+
+	return disk_ioctl(0, CTRL_SYNC, NULL);
+}
+
+// LBAZN^̓eׂvalueǂ 
+static int test_verify(
+	DWORD lba,
+	BYTE value
+)
+{
+	memset(sec, value, TEST_SECTOR_SIZE);
+	if (disk_read(0, chk, lba, 1) != RES_OK) return 0;
+
+	return memcmp(sec, chk, TEST_SECTOR_SIZE) == 0;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Test cases                                                            */
+/*-----------------------------------------------------------------------*/
+
+// FatFsŃt@C쐬Aă}Egɓǂݏo 
+static void test_fatfs(
+	BYTE mode
+)
+{
+	static BYTE work[_MAX_SS];
+	static char buff[8192];
+	char line[32], detail[64];
+	FATFS fs;
+	FIL fil;
+	UINT bw, br, n, pos;
+	int i, ok;
+
+	ok = test_open(TEST_MBIT, 0, mode) &&
+			f_mkfs("", FM_ANY, 0, work, sizeof(work)) == FR_OK &&
+			f_mount(&fs, "", 1) == FR_OK &&
+			f_open(&fil, "test.txt", FA_WRITE | FA_CREATE_ALWAYS) == FR_OK;
+
+	for(i=0, pos=0 ; ok && i<400 ; i++) {
+		n = sprintf(line, "line %d\n", i);
+		if (f_write(&fil, line, n, &bw) != FR_OK || bw != n) ok = 0;
+		pos += n;
+	}
+	if (ok && f_close(&fil) != FR_OK) ok = 0;
+
+	// {[ǂݒĂeׂ 
+	f_mount(NULL, "", 0);
+	if (ok) ok = test_remount() && f_mount(&fs, "", 1) == FR_OK && f_open(&fil, "test.txt", FA_READ) == FR_OK;
+	if (ok) ok = f_read(&fil, buff, sizeof(buff), &br) == FR_OK && br == pos && f_close(&fil) == FR_OK;
+	for(i=0, pos=0 ; ok && i<400 ; i++) {
+		n = sprintf(line, "line %d\n", i);
+		if (memcmp(buff + pos, line, n) != 0) ok = 0;
+		pos += n;
+	}
+	f_mount(NULL, "", 0);
+
+	sprintf(detail, "%u bytes, sim errors %lu", pos, testhost_sim.error_count);
+	test_result(mode == SPIDISK_FORMAT_LOG ? "fatfs (log)" : "fatfs (static)", ok && testhost_sim.error_count == 0, detail);
+	testhost_close();
+}
+
+#if _USE_SPI_SATCACHE
+// ݃G[̃ZN^փZN^ɒuAă}EgSATւ̏ݍ݂̌ǂݏo邱 
+static void test_remap(void)
+{
+	char detail[96];
+	DWORD idle;
+	WORD first, second;
+	int ok;
+
+	ok = test_open(TEST_MBIT, 0, SPIDISK_FORMAT_STATIC);
+
+	// 1ڂ̒u 
+	testhost_badsector(100);
+	if (ok && test_write(100, 0x5a) != RES_OK) ok = 0;
+	testhost_badsector(-1);
+	first = spidisk->lba_table[100];
+	if (first == 100 || !test_verify(100, 0x5a)) ok = 0;
+
+	// ă}Eg̒u͓փZN^gȂ 
+	if (ok && !test_remount()) ok = 0;
+	if (ok && !test_verify(100, 0x5a)) ok = 0;
+	testhost_badsector(200);
+	if (ok && test_write(200, 0xa5) != RES_OK) ok = 0;
+	testhost_badsector(-1);
+	second = spidisk->lba_table[200];
+	if (second == 200 || second == first || !test_verify(200, 0xa5)) ok = 0;
+
+	// W[iSATɏݍłǂݒ 
+	idle = 0;
+	if (ok && disk_ioctl(0, SPIDISK_CTRL_IDLE, &idle) != RES_OK) ok = 0;
+	if (ok && !test_remount()) ok = 0;
+	if (ok && (spidisk->lba_table[100] != first || spidisk->lba_table[200] != second)) ok = 0;
+	if (ok && !(test_verify(100, 0x5a) && test_verify(200, 0xa5))) ok = 0;
+
+	sprintf(detail, "lba 100 -> %u, lba 200 -> %u, folded %lu", first, second, spidisk->stat.sat_fold_count);
+	test_result("remap", ok, detail);
+	testhost_close();
+}
+#endif
+
+#if _USE_SPI_SATJOURNAL && _USE_SPI_SATCACHE
+// SAT̏ݍ݂̓rœd؂ĂW[iփZN^𕜌ł邱 
+static void test_satreplay(void)
+{
+	char detail[96];
+	DWORD lo, hi, idle, reprogram;
+	WORD map[4];
+	int i, ok;
+
+	ok = test_open(TEST_MBIT, 0, SPIDISK_FORMAT_STATIC);
+
+	// R[h̓W[ȉԂ̃oCgɃvO 
+	lo = TEST_PROGRAM_ADDRESS(spidisk->jnl_top_sector);
+	testhost_watchprogram(lo, lo + spidisk->jnl_count * TEST_SECTOR_SIZE);
+
+	for(i=0 ; ok && i<4 ; i++) {
+		testhost_badsector(300 + i * 20);
+		if (test_write(300 + i * 20, 0x30 + i) != RES_OK) ok = 0;
+		map[i] = spidisk->lba_table[300 + i * 20];
+	}
+	testhost_badsector(-1);
+	reprogram = testhost_reprogram_bytes();
+
+	// SATZN^̏̒ɓd؂ 
+	lo = TEST_PROGRAM_ADDRESS(spidisk->sat_top_sector);
+	hi = TEST_PROGRAM_ADDRESS(spidisk->jnl_top_sector);
+	testhost_powercut(lo, hi, 0);
+	idle = 0;
+	if (ok) disk_ioctl(0, SPIDISK_CTRL_IDLE, &idle);
+	if (!testhost_powercut_taken()) ok = 0;
+	testhost_powercut_restore();
+
+	if (ok && !test_remount()) ok = 0;
+	for(i=0 ; ok && i<4 ; i++) {
+		if (spidisk->lba_table[300 + i * 20] != map[i] || !test_verify(300 + i * 20, 0x30 + i)) ok = 0;
+	}
+
+	if (reprogram != 0) ok = 0;
+
+	sprintf(detail, "4 remaps, cut after the SAT erase, reprogram %lu bytes", reprogram);
+	test_result("sat journal replay", ok, detail);
+	testhost_close();
+}
+#endif
+
+#if _USE_SPI_SATJOURNAL && _USE_SPI_SATCACHE
+// W[iւ̃vOsĂAփZN^ׂĊ蓖Ă邱 
+static void test_journalretry(void)
+{
+	char detail[96];
+	DWORD lo, hi, lba;
+	UINT n, rsv;
+	int ok;
+
+	ok = test_open(TEST_MBIT * 4, 300, SPIDISK_FORMAT_STATIC);
+	rsv = spidisk->rsv_count;
+	lo = TEST_PROGRAM_ADDRESS(spidisk->jnl_top_sector);
+	hi = lo + spidisk->jnl_count * TEST_SECTOR_SIZE;
+
+	// ûтɃW[ĩvO2񎸔s 
+	for(n=0 ; ok && n<rsv ; n++) {
+		lba = 10 + n * 5;
+		testhost_badsector(lba);
+		testhost_failprogram(lo, hi, 2);
+		memset(sec, n, TEST_SECTOR_SIZE);
+		if (disk_write(0, sec, lba, 1) != RES_OK) break;
+	}
+	testhost_badsector(-1);
+	testhost_failprogram(0, 0, 0);
+
+	if (n < rsv) ok = 0;
+	if (ok && !test_remount()) ok = 0;
+	for(lba=0 ; ok && lba<n ; lba++) {
+		if (!test_verify(10 + lba * 5, lba)) ok = 0;
+	}
+
+	sprintf(detail, "%u of %u remaps, journal %u sectors", n, rsv, spidisk ? spidisk->jnl_count : 0);
+	test_result("journal retry", ok, detail);
+	testhost_close();
+}
+#endif
+
+#if _USE_SPI_LOGFTL && _USE_SPI_SATCACHE
+// O\̃{[ŁAW[ȉ̒ɓd؂Ăݍς݂̃f[^c邱 
+static void test_powercut(void)
+{
+	static BYTE model[300], snap[300];
+	char detail[96];
+	DWORD lo, hi, reprogram;
+	UINT cut, i, k, lost, writes;
+	unsigned seed;
+	int ok;
+
+	ok = 1;
+	lost = 0;
+	writes = 0;
+	reprogram = 0;
+
+	for(cut=0 ; ok && cut<10 ; cut++) {
+		if (!test_open(TEST_MBIT, 0, SPIDISK_FORMAT_LOG)) {
+			ok = 0;
+			break;
+		}
+
+		// R[h̓W[ȉԂ̃oCgɃvO 
+		lo = TEST_PROGRAM_ADDRESS(spidisk->jnl_top_sector);
+		hi = lo + spidisk->jnl_count * TEST_SECTOR_SIZE;
+		testhost_watchprogram(lo, hi);
+
+		// SLBA2񏑂āAׂẴZN^W[ioRŊ蓖Ă 
+		for(k=0 ; k<2 ; k++) {
+			for(i=0 ; i<300 ; i++) {
+				model[i] = i + k * 0x55;
+				test_write(i, model[i]);
+			}
+		}
+
+		// ꕔLBAAcutڂ̃W[ȉ̒ɓd؂ 
+		testhost_powercut(lo, hi, cut);
+		for(seed=1 ; !testhost_powercut_taken() && writes < 100000 ; writes++) {
+			seed = seed * 1103515245 + 12345;
+			i = (seed >> 16) % 32;
+			memcpy(snap, model, sizeof(model));
+			model[i]++;
+			test_write(i, model[i]);
+		}
+		if (!testhost_powercut_taken()) ok = 0;
+		testhost_powercut_restore();
+		reprogram += testhost_reprogram_bytes();
+
+		// df̎_ŏݒLBA͐Vǂ̓eł悢 
+		if (ok && !test_remount()) ok = 0;
+		for(i=0 ; ok && i<300 ; i++) {
+			if (!test_verify(i, snap[i]) && !test_verify(i, model[i])) lost++;
+		}
+
+		testhost_close();
+	}
+
+	sprintf(detail, "%u cuts, %u writes, %u sectors lost, reprogram %lu bytes", cut, writes, lost, reprogram);
+	test_result("log journal replay", ok && lost == 0 && reprogram == 0, detail);
+}
+#endif
+
+#if SPI_SCRUB_QUEUE > 0 && _USE_SPI_SATCACHE
+// xt@CȂŏZN^XNuŌACTRL_SYNCňڂăG[Ԃ 
+static void test_scrub(
+	BYTE mode
+)
+{
+	DEF_SPIVERIFY verify;
+	char detail[96];
+	DWORD lba = 50, phys;
+	UINT i;
+	int ok;
+
+	ok = test_open(TEST_MBIT, 0, mode);
+	verify.policy = SPIDISK_VERIFY_NONE;
+	verify.interval = SPI_VERIFY_INTERVAL;
+	if (ok && disk_ioctl(0, SPIDISK_SET_VERIFY, &verify) != RES_OK) ok = 0;
+
+	for(i=0 ; ok && i<=SPI_SCRUB_QUEUE+4 ; i++) {
+		if (test_write(lba + i, 0x11) != RES_OK) ok = 0;
+	}
+
+	// 񂾒̃ZN^1rbg 
+	memset(sec, 0x5a, TEST_SECTOR_SIZE);
+	if (ok && disk_write(0, sec, lba, 1) != RES_OK) ok = 0;
+	phys = spidisk->lba_table[lba];
+	testhost_sim.mem[TEST_PROGRAM_ADDRESS(phys) + 100] ^= 0x10;
+
+	// L[ăXNuĂA֌ŴȂ݂̓G[ɂȂȂ 
+	for(i=1 ; ok && i<=SPI_SCRUB_QUEUE+4 ; i++) {
+		memset(sec, 0x20 + i, TEST_SECTOR_SIZE);
+		if (disk_write(0, sec, lba + i, 1) != RES_OK) ok = 0;
+	}
+	if (ok && (spidisk->stat.scrub_error_count != 1 || spidisk->stat.scrub_error_sector != phys)) ok = 0;
+
+	// CTRL_SYNCŃG[ʒmăZN^ڂ 
+	if (ok && disk_ioctl(0, CTRL_SYNC, NULL) != RES_ERROR) ok = 0;
+	if (ok && spidisk->lba_table[lba] == phys) ok = 0;
+	if (ok && disk_ioctl(0, CTRL_SYNC, NULL) != RES_OK) ok = 0;
+	for(i=1 ; ok && i<=SPI_SCRUB_QUEUE+4 ; i++) {
+		if (!test_verify(lba + i, 0x20 + i)) ok = 0;
+	}
+	if (ok && !test_remount()) ok = 0;
+	if (ok && spidisk->lba_table[lba] == phys) ok = 0;
+
+	sprintf(detail, "sector %lu moved to %u", phys, spidisk ? spidisk->lba_table[lba] : 0);
+	test_result(mode == SPIDISK_FORMAT_LOG ? "scrub (log)" : "scrub (static)", ok, detail);
+	testhost_close();
+}
+
+#if _USE_SPI_LOGFTL
+// ŉꂽZN^̃XNu̓G[ɂȂ 
+// (XNu҂̃ZN^͉Ɏ菜AG[ɂȂɉꂽZN^͈ڂȂ) 
+static void test_scrubfree(void)
+{
+	DEF_SPIVERIFY verify;
+	char detail[64];
+	DWORD phys;
+	UINT i;
+	int ok;
+
+	ok = test_open(TEST_MBIT, 0, SPIDISK_FORMAT_LOG);
+	verify.policy = SPIDISK_VERIFY_NONE;
+	verify.interval = SPI_VERIFY_INTERVAL;
+	if (ok && disk_ioctl(0, SPIDISK_SET_VERIFY, &verify) != RES_OK) ok = 0;
+
+	// XNu҂̃ZN^󂵂Ă珑 
+	memset(sec, 0x11, TEST_SECTOR_SIZE);
+	if (ok && disk_write(0, sec, 60, 1) != RES_OK) ok = 0;
+	phys = spidisk->lba_table[60];
+	testhost_sim.mem[TEST_PROGRAM_ADDRESS(phys) + 100] ^= 0x10;
+	if (ok && test_write(60, 0x22) != RES_OK) ok = 0;
+	if (ok && spidisk->stat.scrub_error_count != 0) ok = 0;
+
+	// XNuŃG[ɂȂɏ 
+	memset(sec, 0x33, TEST_SECTOR_SIZE);
+	if (ok && disk_write(0, sec, 61, 1) != RES_OK) ok = 0;
+	phys = spidisk->lba_table[61];
+	testhost_sim.mem[TEST_PROGRAM_ADDRESS(phys) + 100] ^= 0x10;
+	for(i=0 ; ok && i<SPI_SCRUB_QUEUE ; i++) {
+		memset(sec, 0x40 + i, TEST_SECTOR_SIZE);
+		if (disk_write(0, sec, 70 + i, 1) != RES_OK) ok = 0;
+	}
+	if (ok && spidisk->stat.scrub_error_count != 1) ok = 0;
+	memset(sec, 0x44, TEST_SECTOR_SIZE);
+	if (ok && disk_write(0, sec, 61, 1) != RES_OK) ok = 0;
+	if (ok && disk_ioctl(0, CTRL_SYNC, NULL) != RES_OK) ok = 0;
+
+	if (ok && !test_verify(60, 0x22)) ok = 0;
+	if (ok && !test_verify(61, 0x44)) ok = 0;
+
+	sprintf(detail, "scrub errors %lu", spidisk ? spidisk->stat.scrub_error_count : 0);
+	test_result("scrub (freed)", ok, detail);
+	testhost_close();
+}
+#endif
+#endif
+
+#if SPI_ERASE_POOL > 0 && _USE_TRIM
+// CTRL_TRIMŏ҂ɂZN^AChɏA݂ŏȗ邱 
+static void test_pool(void)
+{
+	DWORD range[2], idle;
+	char detail[96];
+	UINT i;
+	int ok;
+
+	ok = test_open(TEST_MBIT, 0, SPIDISK_FORMAT_STATIC);
+	for(i=0 ; ok && i<16 ; i++) {
+		if (test_write(200 + i, 0x40 + i) != RES_OK) ok = 0;
+	}
+
+	range[0] = 200;
+	range[1] = 215;
+	if (ok && disk_ioctl(0, CTRL_TRIM, range) != RES_OK) ok = 0;
+	idle = 0;
+	if (ok && disk_ioctl(0, SPIDISK_CTRL_IDLE, &idle) != RES_OK) ok = 0;
+	if (ok && idle != 0) ok = 0;
+
+	disk_ioctl(0, SPIDISK_CLEAR_STAT, NULL);
+	for(i=0 ; ok && i<16 ; i++) {
+		if (test_write(200 + i, 0x80 + i) != RES_OK) ok = 0;
+	}
+	if (ok && !test_remount()) ok = 0;
+	for(i=0 ; ok && i<16 ; i++) {
+		if (!test_verify(200 + i, 0x80 + i)) ok = 0;
+	}
+
+	sprintf(detail, "pool hit %lu, erase %lu", spidisk ? spidisk->stat.pool_hit_count : 0, spidisk ? spidisk->stat.erase_count : 0);
+	test_result("erase pool", ok && spidisk->stat.pool_hit_count == 16, detail);
+	testhost_close();
+}
+#endif
+
+// tH[}bg̏ς݃ZN^ւ݂̏ƁAς݂̃y[Wւ̒ǋL͏Ȃ 
+// ς݂łȂZN^01̏͏ 
+static void test_blankwrite(void)
+{
+	DWORD erase, skip;
+	char detail[64];
+	UINT i;
+	int ok;
+
+	ok = test_open(TEST_MBIT, 0, SPIDISK_FORMAT_STATIC);
+	for(i=0 ; ok && i<8 ; i++) {
+		if (test_write(300 + i, 0x50 + i) != RES_OK) ok = 0;
+	}
+
+	// ς݂̃y[WςǋLȂ 
+	memset(sec, 0xff, TEST_SECTOR_SIZE);
+	for(i=0 ; ok && i<4 ; i++) {
+		memset(sec + i * 256, 0x60 + i, 256);
+		if (disk_write(0, sec, 310, 1) != RES_OK) ok = 0;
+	}
+	if (ok && disk_ioctl(0, CTRL_SYNC, NULL) != RES_OK) ok = 0;
+	if (ok && disk_read(0, chk, 310, 1) != RES_OK) ok = 0;
+	if (ok && memcmp(sec, chk, TEST_SECTOR_SIZE) != 0) ok = 0;
+
+	erase = spidisk ? spidisk->stat.erase_count : 0;
+	skip = spidisk ? spidisk->stat.erase_skip_count : 0;
+	if (erase != 0 || skip != 12) ok = 0;
+
+	if (ok && test_write(300, 0xa5) != RES_OK) ok = 0;
+	if (ok && spidisk->stat.erase_count != 1) ok = 0;
+
+	if (ok && !test_remount()) ok = 0;
+	if (ok && !test_verify(300, 0xa5)) ok = 0;
+	for(i=1 ; ok && i<8 ; i++) {
+		if (!test_verify(300 + i, 0x50 + i)) ok = 0;
+	}
+
+	sprintf(detail, "%lu skipped, %lu erased on fresh sectors and pages", skip, erase);
+	test_result("blank write", ok, detail);
+	testhost_close();
+}
+
+#if _USE_SPI_BLOCKERASE
+// JESD216(őO)9DWORDSFDPłADWORD8-9̃ubNg 
+static void test_sfdprev0(void)
+{
+	static BYTE buff[TEST_SECTOR_SIZE * 32];
+	DEF_SPIDISK_SIMCONFIG config;
+	char detail[64];
+	UINT i;
+	int ok;
+
+	spidisk_sim_config(&config, TEST_MBIT * 1024 * 1024 / 8);
+	ok = testhost_open(&config, NULL, TESTHOST_IF_SIM) == RES_OK;
+	testhost_sim.sfdp[4] = 0x00;			// JESD216 (1.0) 
+	testhost_sim.sfdp[9] = 0x00;
+	testhost_sim.sfdp[11] = 9;				// {p[^9DWORD 
+
+	if (ok && spidisk_format(0, 0, SPIDISK_FORMAT_STATIC) != RES_OK) ok = 0;
+	spidisk = NULL;
+	if (ok && disk_initialize(0) != 0) ok = 0;
+
+	// 1ڂ͏ς݂̃ZN^ւ̏݁A2ڂ01܂ޏŃubNɂȂ 
+	memset(buff, 0x11, sizeof(buff));
+	if (ok && disk_write(0, buff, 100, 32) != RES_OK) ok = 0;
+	if (ok && disk_ioctl(0, SPIDISK_CLEAR_STAT, NULL) != RES_OK) ok = 0;
+	memset(buff, 0xee, sizeof(buff));
+	if (ok && disk_write(0, buff, 100, 32) != RES_OK) ok = 0;
+	if (ok && disk_ioctl(0, CTRL_SYNC, NULL) != RES_OK) ok = 0;
+
+	memset(buff, 0, sizeof(buff));
+	if (ok && disk_read(0, buff, 100, 32) != RES_OK) ok = 0;
+	for(i=0 ; ok && i<sizeof(buff) ; i++) {
+		if (buff[i] != 0xee) ok = 0;
+	}
+
+	sprintf(detail, "%lu block erases, sim errors %lu", spidisk ? spidisk->stat.block_erase_count : 0, testhost_sim.error_count);
+	test_result("sfdp rev0 block", ok && spidisk->stat.block_erase_count > 0 && testhost_sim.error_count == 0, detail);
+	testhost_close();
+}
+#endif
+
+// DMAE}bvǂݏoEzXgubW̊eoHœeǂݏo邱 
+static void test_transport(void)
+{
+	static const struct {
+		const char *name;
+		BYTE buswidth, dma, mapped, transport;
+	} path[] = {
+		{"x1",         1, 0, 0, TESTHOST_IF_SIM},
+		{"x4",         4, 0, 0, TESTHOST_IF_SIM},
+		{"dma",        1, 1, 0, TESTHOST_IF_SIM},
+		{"mapped",     1, 0, 1, TESTHOST_IF_SIM},
+		{"hostbridge", 1, 0, 0, TESTHOST_IF_HOSTBRIDGE},
+		{"linux",      1, 0, 0, TESTHOST_IF_LINUX}
+	};
+	static BYTE buff[TEST_SECTOR_SIZE * 8];
+	DEF_SPIDISK_SIMCONFIG config;
+	char name[32], detail[64];
+	UINT i, n;
+	int ok;
+
+	for(n=0 ; n<sizeof(path)/sizeof(path[0]) ; n++) {
+		spidisk_sim_config(&config, TEST_MBIT * 1024 * 1024 / 8);
+		config.buswidth = path[n].buswidth;
+		config.dma = path[n].dma;
+		config.mapped_read = path[n].mapped;
+
+		ok = testhost_open(&config, NULL, path[n].transport) == RES_OK &&
+				spidisk_format(0, 0, SPIDISK_FORMAT_STATIC) == RES_OK;
+		spidisk = NULL;
+		if (ok && disk_initialize(0) != 0) ok = 0;
+
+		for(i=0 ; i<sizeof(buff) ; i++) buff[i] = i * 7 + n;
+		if (ok && disk_write(0, buff, 64, 8) != RES_OK) ok = 0;
+		if (ok && disk_ioctl(0, CTRL_SYNC, NULL) != RES_OK) ok = 0;
+		memset(buff, 0, sizeof(buff));
+		if (ok && disk_read(0, buff, 64, 8) != RES_OK) ok = 0;
+		for(i=0 ; ok && i<sizeof(buff) ; i++) {
+			if (buff[i] != (BYTE)(i * 7 + n)) ok = 0;
+		}
+
+		sprintf(name, "transport %s", path[n].name);
+		sprintf(detail, "sim errors %lu", testhost_sim.error_count);
+		test_result(name, ok && testhost_sim.error_count == 0, detail);
+		testhost_close();
+	}
+}
+
+
+// spideṽbZ[W̕ƃG[̓` 
+// 1ZN^̓ǂݏobufsiz2̃bZ[WɕAcs_change1̃`bvZNgɂȂ 
+static void test_linux(void)
+{
+	static const DEF_SPICOMMAND rdsr = {0x05, 0, 0, 1, 1, 0, 0xff, 0, NULL, NULL, 1};
+	DEF_SPIDISK_SIMCONFIG config;
+	DWORD messages, transfers, commands;
+	char detail[64];
+	int ok, err;
+
+	spidisk_sim_config(&config, TEST_MBIT * 1024 * 1024 / 8);
+	ok = testhost_open(&config, NULL, TESTHOST_IF_LINUX) == RES_OK &&
+			spidisk_format(0, 0, SPIDISK_FORMAT_STATIC) == RES_OK;
+	spidisk = NULL;
+	if (ok && disk_initialize(0) != 0) ok = 0;
+
+	memset(sec, 0x5a, sizeof(sec));
+	if (ok && disk_write(0, sec, 10, 1) != RES_OK) ok = 0;
+	if (ok && disk_ioctl(0, CTRL_SYNC, NULL) != RES_OK) ok = 0;
+
+	testhost_linux.message_count = 0;
+	testhost_linux.transfer_count = 0;
+	commands = testhost_sim.command_count;
+	memset(chk, 0, sizeof(chk));
+	if (ok && disk_read(0, chk, 10, 1) != RES_OK) ok = 0;
+	if (ok && memcmp(sec, chk, sizeof(sec)) != 0) ok = 0;
+	messages = testhost_linux.message_count;
+	transfers = testhost_linux.transfer_count;
+	commands = testhost_sim.command_count - commands;
+	if (messages != 2 || transfers != 3 || commands != 1) ok = 0;
+
+	// sioctldisk_read̃G[ɂȂ 
+	testhost_failmessage(1);
+	if (ok && disk_read(0, chk, 10, 1) == RES_OK) ok = 0;
+
+	// 1oCg]̎s͎burstŕԂ 
+	testhost_failmessage(1);
+	testhost_linux.spi_if.transfer(&testhost_linux, 0x05);
+	testhost_linux.spi_if.select(&testhost_linux, 0);
+	err = testhost_linux.error;
+	if (err == 0) ok = 0;
+	if (testhost_linux.spi_if.burst(&testhost_linux, &rdsr) != RES_ERROR) ok = 0;
+	if (testhost_linux.error != 0) ok = 0;
+	if (ok && disk_read(0, chk, 10, 1) != RES_OK) ok = 0;
+
+	sprintf(detail, "read %lu messages, %lu transfers, %lu commands", messages, transfers, commands);
+	test_result("linux message", ok && testhost_sim.error_count == 0, detail);
+	testhost_close();
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Main                                                                  */
+/*-----------------------------------------------------------------------*/
+
+int main(void)
+{
+	setvbuf(stdout, NULL, _IONBF, 0);
+
+	test_fatfs(SPIDISK_FORMAT_STATIC);
+#if _USE_SPI_LOGFTL && _USE_SPI_SATCACHE
+	test_fatfs(SPIDISK_FORMAT_LOG);
+#endif
+	test_transport();
+	test_linux();
+	test_blankwrite();
+#if _USE_SPI_BLOCKERASE
+	test_sfdprev0();
+#endif
+#if _USE_SPI_SATCACHE
+	test_remap();
+#endif
+#if _USE_SPI_SATJOURNAL && _USE_SPI_SATCACHE
+	test_satreplay();
+	test_journalretry();
+#endif
+#if _USE_SPI_LOGFTL && _USE_SPI_SATCACHE
+	test_powercut();
+#endif
+#if SPI_SCRUB_QUEUE > 0 && _USE_SPI_SATCACHE
+	test_scrub(SPIDISK_FORMAT_STATIC);
+ #if _USE_SPI_LOGFTL
+	test_scrub(SPIDISK_FORMAT_LOG);
+	test_scrubfree();
+ #endif
+#endif
+#if SPI_ERASE_POOL > 0 && _USE_TRIM
+	test_pool();
+#endif
+
+	printf("%d test(s) failed\n", test_failed);
+
+	return test_failed ? 1 : 0;
+}
@@ -0,0 +1,392 @@
+// ------------------------------------------------------------------- //
+//  PERIDOT-NGS SPI flash Filesystem (test host)                       //
+// ------------------------------------------------------------------- //
+//
+//  ver 0.91
+//		2017/03/11	s.osafune@gmail.com
+//
+// ******************************************************************* //
+//  The MIT License (MIT)
+//  Copyright (c) 2017 J-7SYSTEM WORKS LIMITED.
+//
+//  Permission is hereby granted, free of charge, to any person
+//  obtaining a copy of this software and associated documentation
+//  files (the "Software"), to deal in the Software without restriction,
+//  including without limitation the rights to use, copy, modify, merge,
+//  publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be
+//  included in all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+//  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+//  NONINFRINGEMENT.
+//  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+//  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+//  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// ******************************************************************* //
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "spidisk.h"
+#include "spidisk_sim.h"
+#include "spidisk_hostbridge.h"
+#include "spidisk_linux.h"
+#include "spidisk_testhost.h"
+
+
+/*-----------------------------------------------------------------------*/
+/* Define a macro                                                        */
+/*-----------------------------------------------------------------------*/
+
+#define HOST_SS_ASSERT			(1<<8)
+#define HOST_TRANS_READY		(1<<9)
+
+#define HOST_IS_PROGRAM(_op)	((_op) == 0x02 || (_op) == 0x12)
+#define HOST_IS_ERASE(_op)		((_op) == 0x20 || (_op) == 0x21)
+
+
+DEF_SPIDISK_SIM testhost_sim;
+DWORD testhost_regaccess;
+DEF_SPIDISK_LINUX testhost_linux;
+
+static DEF_SPIDISK_IF host_if;
+static DRESULT (*host_burst)(void *context, const DEF_SPICOMMAND *cmd);
+static BYTE host_rxdata;
+
+// Q̒ 
+static long bad_sector = -1;
+static DWORD fail_lo, fail_hi;
+static UINT fail_count;
+static DWORD cut_lo, cut_hi;
+static UINT cut_skip;
+static int cut_armed, cut_taken;
+static BYTE *cut_image;
+static UINT msg_fail_count;
+static DWORD watch_lo, watch_hi, watch_bytes;
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Fault injection                                                       */
+/*-----------------------------------------------------------------------*/
+
+// vOf[^̍ŏ0łȂoCg̍ŉʂ1rbg 
+static void host_corrupt(
+	const DEF_SPICOMMAND *cmd
+)
+{
+	DWORD i;
+	BYTE b;
+
+	for(i=0 ; i<cmd->length ; i++) {
+		b = cmd->txbuff[i];
+		if (b) {
+			testhost_sim.mem[cmd->address + i] &= ~(b & -b);
+			return;
+		}
+	}
+}
+
+// V~[^̃o[Xg]̌ɏQ𒍓 
+static DRESULT host_fault_burst(
+	void *context,
+	const DEF_SPICOMMAND *cmd
+)
+{
+	DRESULT res;
+	DWORD i;
+
+	// ɃvOς݂̃oCgւ̃vO𐔂 
+	if (HOST_IS_PROGRAM(cmd->opcode) && cmd->txbuff != NULL && cmd->address >= watch_lo && cmd->address < watch_hi) {
+		for(i=0 ; i<cmd->length ; i++) {
+			if (testhost_sim.mem[cmd->address + i] != 0xff) watch_bytes++;
+		}
+	}
+
+	res = host_burst(context, cmd);
+
+	if (HOST_IS_PROGRAM(cmd->opcode) && cmd->txbuff != NULL) {
+		if (bad_sector >= 0 && cmd->address / 4096 == (DWORD)bad_sector) {
+			host_corrupt(cmd);
+		} else if (fail_count > 0 && cmd->address >= fail_lo && cmd->address < fail_hi) {
+			host_corrupt(cmd);
+			fail_count--;
+		}
+	}
+
+	if (HOST_IS_ERASE(cmd->opcode) && cut_armed && !cut_taken && cmd->address >= cut_lo && cmd->address < cut_hi) {
+		if (cut_skip > 0) {
+			cut_skip--;
+		} else {
+			memcpy(cut_image, testhost_sim.mem, testhost_sim.config.memsize);
+			cut_taken = 1;
+		}
+	}
+
+	return res;
+}
+
+
+void testhost_badsector(
+	long sector
+)
+{
+	bad_sector = sector;
+}
+
+
+void testhost_failprogram(
+	DWORD lo,
+	DWORD hi,
+	UINT count
+)
+{
+	fail_lo = lo;
+	fail_hi = hi;
+	fail_count = count;
+}
+
+
+void testhost_watchprogram(
+	DWORD lo,
+	DWORD hi
+)
+{
+	watch_lo = lo;
+	watch_hi = hi;
+	watch_bytes = 0;
+}
+
+
+DWORD testhost_reprogram_bytes(void)
+{
+	return watch_bytes;
+}
+
+
+void testhost_failmessage(
+	UINT count
+)
+{
+	msg_fail_count = count;
+}
+
+
+void testhost_powercut(
+	DWORD lo,
+	DWORD hi,
+	UINT skip
+)
+{
+	if (cut_image == NULL) cut_image = malloc(testhost_sim.config.memsize);
+
+	cut_lo = lo;
+	cut_hi = hi;
+	cut_skip = skip;
+	cut_armed = (cut_image != NULL);
+	cut_taken = 0;
+}
+
+
+int testhost_powercut_taken(void)
+{
+	return cut_taken;
+}
+
+
+void testhost_powercut_restore(void)
+{
+	if (cut_taken) memcpy(testhost_sim.mem, cut_image, testhost_sim.config.memsize);
+
+	cut_armed = 0;
+	cut_taken = 0;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Hostbridge register model                                             */
+/*-----------------------------------------------------------------------*/
+
+// SSrbg1̃oCg̓`bvZNgAT[gē]A0̃oCg̓lQ[g 
+void testhost_iowr(
+	DWORD base,
+	int reg,
+	DWORD data
+)
+{
+	testhost_regaccess++;
+
+	if (data & HOST_SS_ASSERT) {
+		host_rxdata = testhost_sim.spi_if.transfer(&testhost_sim, data & 0xff);
+	} else {
+		testhost_sim.spi_if.select(&testhost_sim, 0);
+		host_rxdata = 0xff;
+	}
+}
+
+DWORD testhost_iord(
+	DWORD base,
+	int reg
+)
+{
+	testhost_regaccess++;
+
+	return HOST_TRANS_READY | host_rxdata;
+}
+
+// zXgubWɂ͎ԑ҂Ȃ߁AV~[VԂi߂ 
+static void host_delay(
+	void *context,
+	DWORD usec
+)
+{
+	testhost_sim.spi_if.delay(&testhost_sim, usec);
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* spidev message model                                                  */
+/*-----------------------------------------------------------------------*/
+
+// spideṽbZ[WV~[^1oCg]ɓWJ 
+// cs_change͓r̓]ł͂̌ɃlQ[gAŌ̓]ł̓bZ[WIAT[gێ 
+static int host_message(
+	DEF_SPIDISK_LINUX *dev,
+	struct spi_ioc_transfer *xfer,
+	UINT count
+)
+{
+	DEF_SPIDISK_SIM *sim = (DEF_SPIDISK_SIM *)dev->message_arg;
+	const BYTE *tx;
+	BYTE *rx, recv;
+	DWORD i, total;
+	UINT n;
+
+	// sbZ[W̓`bvZNglQ[gďI 
+	if (msg_fail_count > 0) {
+		msg_fail_count--;
+		sim->spi_if.select(sim, 0);
+		return -1;
+	}
+
+	total = 0;
+	for(n=0 ; n<count ; n++,xfer++) {
+		if (xfer->tx_nbits > 1 || xfer->rx_nbits > 1) {
+			sim->error_count++;
+			sim->spi_if.select(sim, 0);
+			return -1;
+		}
+
+		tx = (const BYTE *)(unsigned long)xfer->tx_buf;
+		rx = (BYTE *)(unsigned long)xfer->rx_buf;
+		for(i=0 ; i<xfer->len ; i++) {
+			recv = sim->spi_if.transfer(sim, (tx != NULL)? tx[i] : 0xff);
+			if (rx != NULL) rx[i] = recv;
+		}
+		total += xfer->len;
+
+		if ((n < count-1) == (xfer->cs_change != 0)) sim->spi_if.select(sim, 0);
+	}
+
+	return total;
+}
+
+
+
+/*-----------------------------------------------------------------------*/
+/* Open/Close test host                                                  */
+/*-----------------------------------------------------------------------*/
+
+DRESULT testhost_open(
+	const DEF_SPIDISK_SIMCONFIG *config,
+	const char *path,
+	BYTE transport
+)
+{
+	DRESULT res;
+
+	res = spidisk_sim_open(&testhost_sim, path, config);
+	if (res != RES_OK) return res;
+
+	testhost_regaccess = 0;
+	testhost_badsector(-1);
+	testhost_failprogram(0, 0, 0);
+	testhost_failmessage(0);
+	testhost_watchprogram(0, 0);
+	cut_armed = 0;
+	cut_taken = 0;
+
+	if (transport == TESTHOST_IF_LINUX) {
+		spidisk_linux_open(&testhost_linux, NULL, config->clock_hz, 1);
+		testhost_linux.message = host_message;
+		testhost_linux.message_arg = &testhost_sim;
+		testhost_linux.spi_if.delay = host_delay;
+		return spidisk_register(&testhost_linux.spi_if, &testhost_linux);
+	}
+
+	if (transport == TESTHOST_IF_HOSTBRIDGE) {
+		host_if = spidisk_if_hostbridge;
+		host_if.delay = host_delay;
+		return spidisk_register(&host_if, NULL);
+	}
+
+	host_burst = testhost_sim.spi_if.burst;
+	testhost_sim.spi_if.burst = host_fault_burst;
+
+	return spidisk_register(&testhost_sim.spi_if, &testhost_sim);
+}
+
+
+void testhost_close(void)
+{
+	spidisk_sim_close(&testhost_sim);
+	free(cut_image);
+	cut_image = NULL;
+}
+
+
+void testhost_report(
+	const char *label
+)
+{
+	DEF_SPIDISK_SIM *sim = &testhost_sim;
+
+	printf("%-12s time=%.3fms cpu=%.3fms bus=%.3fms busy=%.3fms cmd=%lu poll=%lu prog=%lu erase=%lu rd=%llu",
+		label, sim->time_ns / 1e6, (sim->time_ns - sim->wait_time_ns) / 1e6, sim->bus_time_ns / 1e6, sim->busy_time_ns / 1e6,
+		sim->command_count, sim->status_count, sim->program_count, sim->erase_count,
+		sim->read_bytes[0] + sim->read_bytes[1] + sim->read_bytes[2]);
+	if (sim->dma_count) printf(" dma=%lu", sim->dma_count);
+	if (sim->map_count) printf(" map=%lu", sim->map_count);
+	if (sim->suspend_count) printf(" suspend=%lu", sim->suspend_count);
+	if (sim->error_count) printf(" ERROR=%lu", sim->error_count);
+	printf("\n");
+}
+
+
+void testhost_clear(void)
+{
+	spidisk_sim_clear(&testhost_sim);
+	testhost_regaccess = 0;
+}
+
+
+QWORD testhost_time(void)
+{
+	return testhost_sim.time_ns;
+}
+
+
+DWORD get_fattime(void)
+{
+	return ((DWORD)(2017 - 1980) << 25) | ((DWORD)3 << 21) | ((DWORD)11 << 16);
+}
@@ -0,0 +1,131 @@
+// ------------------------------------------------------------------- //
+//  PERIDOT-NGS SPI flash Filesystem (test host)                       //
+// ------------------------------------------------------------------- //
+//
+//  ver 0.91
+//		2017/03/11	s.osafune@gmail.com
+//
+// ******************************************************************* //
+//  The MIT License (MIT)
+//  Copyright (c) 2017 J-7SYSTEM WORKS LIMITED.
+//
+//  Permission is hereby granted, free of charge, to any person
+//  obtaining a copy of this software and associated documentation
+//  files (the "Software"), to deal in the Software without restriction,
+//  including without limitation the rights to use, copy, modify, merge,
+//  publish, distribute, sublicense, and/or sell copies of the Software,
+//  and to permit persons to whom the Software is furnished to do so,
+//  subject to the following conditions:
+//
+//  The above copyright notice and this permission notice shall be
+//  included in all copies or substantial portions of the Software.
+//
+//  THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+//  EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+//  OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+//  NONINFRINGEMENT.
+//  IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR
+//  ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF
+//  CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+//  WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+//
+// ******************************************************************* //
+
+
+
+#ifndef _SPIDISK_TESTHOST_DEFINED
+#define _SPIDISK_TESTHOST_DEFINED
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include "spidisk.h"
+#include "spidisk_sim.h"
+#include "spidisk_linux.h"
+
+
+/*-----------------------------------------------------------------------*/
+/* Function prototype                                                    */
+/*-----------------------------------------------------------------------*/
+
+// hCoƃV~[^̊Ԃ̃C^[tF[X 
+#define TESTHOST_IF_SIM			(0)		// V~[^̃C^[tF[X𒼐ڎg 
+#define TESTHOST_IF_HOSTBRIDGE	(1)		// spidisk_hostbridge.cWX^foRŎg 
+#define TESTHOST_IF_LINUX		(2)		// spidisk_linux.cmessageoRŎg(oX1̂) 
+
+extern DEF_SPIDISK_SIM testhost_sim;	// V~[^ 
+extern DWORD testhost_regaccess;		// zXgubW̃WX^ANZX 
+extern DEF_SPIDISK_LINUX testhost_linux;	// spidevC^[tF[X 
+
+
+// V~[^JăhCoɓo^(pathNULL̏ꍇ̓̃C[W) 
+DRESULT testhost_open(
+	const DEF_SPIDISK_SIMCONFIG *config,
+	const char *path,
+	BYTE transport			// TESTHOST_IF_xxx
+);
+
+// V~[^ 
+void testhost_close(void);
+
+// V~[VԂƓv̕\ 
+void testhost_report(
+	const char *label
+);
+
+// V~[VԂƓṽNA 
+void testhost_clear(void);
+
+// o߂V~[V(ns) 
+QWORD testhost_time(void);
+
+// w肵ZN^ւ̃y[WvO1rbg(-1=) 
+void testhost_badsector(
+	long sector
+);
+
+// AhXlo`hi-1̃y[WvOcount񎸔s 
+void testhost_failprogram(
+	DWORD lo,
+	DWORD hi,
+	UINT count
+);
+
+// AhXlo`hi-1̃y[WvOŁAvOς݂̃oCg֏oCg𐔂n߂ 
+void testhost_watchprogram(
+	DWORD lo,
+	DWORD hi
+);
+
+// testhost_watchprogram̃vOς݂̃oCgւ̃vÕoCg 
+DWORD testhost_reprogram_bytes(void);
+
+// AhXlo`hi-1̃ZN^skip+1ڂŃC[Wۑ(df̖͋[) 
+void testhost_powercut(
+	DWORD lo,
+	DWORD hi,
+	UINT skip
+);
+
+// spideṽbZ[Wcount񎸔s 
+void testhost_failmessage(
+	UINT count
+);
+
+// df̎_̃C[Wۑǂ 
+int testhost_powercut_taken(void);
+
+// ۑC[Wɖ߂ďQ̒ 
+void testhost_powercut_restore(void);
+
+// FatFs̎(Œl) 
+DWORD get_fattime(void);
+
+
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif